@@ -0,0 +1,221 @@
+import argparse
+import itertools
+import sys
+
+import numpy as np
+
+# Control period and drive_motor slew filter, must match the firmware
+PERIOD_S = 0.01
+ALPHA_UP = 0.8
+ALPHA_DOWN = 0.99
+
+# Parameter grid for point location: pressure error, filtered command error, steady state command
+GRID = [("DP", -20.0, 2.5, 17), ("DU", -1.0, 0.125, 17), ("USS", 0.0, 0.125, 9)]
+
+# Default plant, pressure in cm-H2O per filtered command, about 20 cm-H2O at full command
+DEFAULT_A = 0.85
+DEFAULT_B = 3.0
+
+
+def identify(path):
+    """ Fits p[k+1] = a p[k] + b u[k] + c to the pressure and output telemetry in a recording """
+    from interface import FrameReader, decode_telemetry, FRAME_TELEMETRY
+
+    reader = FrameReader()
+    with open(path, "rb") as f:
+        frames = reader.feed(f.read())
+    measurements = decode_telemetry([frame for frame in frames if frame.frame_type == FRAME_TELEMETRY])
+    if "pressure" not in measurements or "output" not in measurements:
+        raise ValueError("{} needs both the pressure and output signals".format(path))
+
+    p_times, pressure = measurements["pressure"]
+    u_times, output = measurements["output"]
+    times, p_index, u_index = np.intersect1d(p_times, u_times, return_indices=True)
+    pressure = pressure[p_index].astype(float)
+    output = output[u_index].astype(float)
+
+    period_ms = np.median(np.diff(times))
+    if abs(period_ms - 1000 * PERIOD_S) > 0.5:
+        print("warning: samples are {} ms apart, subscribe both signals without decimation".format(period_ms))
+
+    # Only consecutive samples
+    step = np.diff(times) == np.round(period_ms)
+    regressors = np.column_stack([pressure[:-1], output[:-1], np.ones(len(pressure) - 1)])[step]
+    (a, b, c), *_ = np.linalg.lstsq(regressors, pressure[1:][step], rcond=None)
+    print("Identified p[k+1] = {:.4f} p[k] + {:.4f} u[k] + {:.4f} from {} samples".format(a, b, c, step.sum()))
+    return a, b
+
+
+def prediction(a, b, alpha, horizon):
+    """ Pressure predictions over the horizon, P = Phi x0 + Gamma U, for x = (dp, du filtered) """
+    A = np.array([[a, b], [0.0, alpha]])
+    B = np.array([0.0, 1.0 - alpha])
+    phi = np.zeros((horizon, 2))
+    gamma = np.zeros((horizon, horizon))
+    power = np.eye(2)
+    for k in range(horizon):
+        power = A @ power
+        phi[k] = power[0]
+        for j in range(k + 1):
+            gamma[k, j] = (np.linalg.matrix_power(A, k - j) @ B)[0]
+    return phi, gamma
+
+
+def solve_box_qp(H, f, lo, hi):
+    """ Primal active set for min 0.5 U'HU + f'U with lo <= U <= hi, returns U and the active set """
+    n = len(f)
+    active = np.zeros(n, dtype=int)
+    for _ in range(4 * n + 10):
+        U = np.where(active < 0, lo, np.where(active > 0, hi, 0.0))
+        free = active == 0
+        if free.any():
+            U[free] = np.linalg.solve(H[np.ix_(free, free)], -(f[free] + H[np.ix_(free, ~free)] @ U[~free]))
+        below = free & (U < lo - 1e-9)
+        above = free & (U > hi + 1e-9)
+        if below.any() or above.any():
+            active[below] = -1
+            active[above] = 1
+            continue
+        gradient = H @ U + f
+        wrong = ((active < 0) & (gradient < -1e-9)) | ((active > 0) & (gradient > 1e-9))
+        if not wrong.any():
+            return U, tuple(active)
+        active[np.argmax(np.where(wrong, np.abs(gradient), -1.0))] = 0
+    raise RuntimeError("box QP did not converge")
+
+
+def first_move_law(H, F, active):
+    """ Coefficients of the first move, u0 = k . (dp, du, uss) + k0, with the active set fixed """
+    def first_move(theta):
+        dp, du, uss = theta
+        lo, hi = -uss, 1.0 - uss
+        f = F @ np.array([dp, du])
+        active_array = np.array(active)
+        U = np.where(active_array < 0, lo, np.where(active_array > 0, hi, 0.0))
+        free = active_array == 0
+        if free.any():
+            U[free] = np.linalg.solve(H[np.ix_(free, free)], -(f[free] + H[np.ix_(free, ~free)] @ U[~free]))
+        return U[0]
+
+    offset = first_move((0.0, 0.0, 0.0))
+    gains = [first_move(unit) - offset for unit in np.eye(3)]
+    return tuple(np.round(gains + [offset], 7) + 0.0)
+
+
+def solve(a, b, alpha, horizon, q, r):
+    """ Returns the distinct first move laws and the law index of every grid cell """
+    phi, gamma = prediction(a, b, alpha, horizon)
+    H = 2.0 * (q * gamma.T @ gamma + r * np.eye(horizon))
+    F = 2.0 * q * gamma.T @ phi
+
+    laws = []
+    law_index = {}
+    cells = np.zeros([points for _, _, _, points in reversed(GRID)], dtype=int)
+    for indices in itertools.product(*[range(points) for _, _, _, points in GRID]):
+        # Cell centres
+        dp, du, uss = [start + (i + 0.5) * step for (_, start, step, _), i in zip(GRID, indices)]
+        uss = min(uss, 1.0)
+        U, active = solve_box_qp(H, F @ np.array([dp, du]), -uss * np.ones(horizon), (1.0 - uss) * np.ones(horizon))
+        law = first_move_law(H, F, active)
+        if law not in law_index:
+            law_index[law] = len(laws)
+            laws.append(law)
+        cells[indices[2], indices[1], indices[0]] = law_index[law]
+    if len(laws) > 255:
+        raise ValueError("{} regions do not fit the uint8_t cell table, coarsen the grid".format(len(laws)))
+    return laws, cells
+
+
+def evaluate(laws, cells, dp, du, uss):
+    """ Same point location and law as empc.c """
+    indices = []
+    for (_, start, step, points), value in zip(GRID, (dp, du, uss)):
+        indices.append(min(max(int(np.floor((value - start) / step)), 0), points - 1))
+    k_dp, k_du, k_uss, k0 = laws[cells[indices[2], indices[1], indices[0]]]
+    return uss + k_dp * dp + k_du * du + k_uss * uss + k0
+
+
+def benchmark(a, b, laws, cells, kp, peep, pip, seconds=1.5):
+    """ Closed loop PEEP to PIP step on the model, PIDF (kp, model feedforward) against the explicit MPC """
+    results = {}
+    for name in ["PIDF", "EMPC"]:
+        pressure = peep
+        filtered = peep * (1.0 - a) / b
+        trace = []
+        for k in range(int(seconds / PERIOD_S)):
+            uss = pip * (1.0 - a) / b
+            if name == "PIDF":
+                command = uss + kp * (pip - pressure)
+            else:
+                command = evaluate(laws, cells, pressure - pip, filtered - uss, uss)
+            command = min(max(command, 0.0), 1.0)
+            alpha = ALPHA_UP if command >= filtered else ALPHA_DOWN
+            filtered = alpha * filtered + (1.0 - alpha) * command
+            pressure = a * pressure + b * filtered
+            trace.append(pressure)
+        trace = np.array(trace)
+        span = pip - peep
+        if trace.max() < peep + 0.9 * span:
+            print("  {}: does not reach 90% of the step".format(name))
+            continue
+        rise = np.argmax(trace >= peep + 0.9 * span) - np.argmax(trace >= peep + 0.1 * span)
+        overshoot = max(0.0, 100.0 * (trace.max() - pip) / span)
+        results[name] = (1000 * PERIOD_S * rise, overshoot)
+        print("  {}: 10-90% rise {:.0f} ms, overshoot {:.1f}%".format(name, *results[name]))
+    return results
+
+
+def write_table(path, a, b, alpha, horizon, q, r, laws, cells):
+    with open(path, "w") as f:
+        f.write("/*\n * Explicit MPC regions, generated by Interface/empc_gen.py, do not edit\n *\n")
+        f.write(" * Plant p[k+1] = {:.5g} p[k] + {:.5g} u[k] behind the {:.3g} command filter\n".format(a, b, alpha))
+        f.write(" * Horizon {}, pressure weight {:.5g}, command weight {:.5g}\n */\n\n".format(horizon, q, r))
+        f.write("#ifndef EMPC_TABLE_H_\n#define EMPC_TABLE_H_\n\n")
+        for name, start, step, points in GRID:
+            f.write("#define EMPC_{}_MIN\t\t({:g})\n".format(name, start))
+            f.write("#define EMPC_{}_STEP\t\t({:g})\n".format(name, step))
+            f.write("#define EMPC_{}_CELLS\t({})\n".format(name, points))
+        f.write("#define EMPC_NUM_REGIONS\t({})\n\n".format(len(laws)))
+        f.write("// First move per region: gains on pressure error, filtered command error and steady state command, then offset\n")
+        f.write("static const float empc_regions[EMPC_NUM_REGIONS][4] =\n{\n")
+        for law in laws:
+            f.write("\t{{{}}},\n".format(", ".join("{:.7g}".format(value) for value in law)))
+        f.write("};\n\n")
+        f.write("// Region of each cell, [USS][DU][DP]\n")
+        f.write("static const uint8_t empc_cells[EMPC_USS_CELLS][EMPC_DU_CELLS][EMPC_DP_CELLS] =\n{\n")
+        for plane in cells:
+            f.write("\t{\n")
+            for row in plane:
+                f.write("\t\t{{{}}},\n".format(", ".join(str(value) for value in row)))
+            f.write("\t},\n")
+        f.write("};\n\n#endif /* EMPC_TABLE_H_ */\n")
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Solve an explicit MPC pressure law and write the region table for empc.c")
+    parser.add_argument("--identify", help="fit the plant to a recording made with interface.py --record")
+    parser.add_argument("--a", type=float, default=DEFAULT_A, help="plant pressure pole per control period")
+    parser.add_argument("--b", type=float, default=DEFAULT_B, help="plant gain, cm-H2O per filtered command per period")
+    parser.add_argument("--horizon", type=int, default=8, help="prediction horizon in control periods")
+    parser.add_argument("--q", type=float, default=1.0, help="weight on pressure error squared")
+    parser.add_argument("--r", type=float, default=200.0, help="weight on command deviation squared")
+    parser.add_argument("--kp", type=float, default=0.01, help="PIDF kp for the benchmark")
+    parser.add_argument("--peep", type=float, default=5.0, help="benchmark step start, cm-H2O")
+    parser.add_argument("--pip", type=float, default=15.0, help="benchmark step end, cm-H2O")
+    parser.add_argument("--output", default="../LCV/src/lib/empc_table.h", help="table header to write")
+    args = parser.parse_args()
+
+    a, b = identify(args.identify) if args.identify else (args.a, args.b)
+    if not 0.0 < a < 1.0 or b <= 0.0:
+        print("error: plant a = {:.4f}, b = {:.4f} is not a stable rising response".format(a, b))
+        sys.exit(1)
+
+    laws, cells = solve(a, b, ALPHA_UP, args.horizon, args.q, args.r)
+    print("{} regions over {} cells".format(len(laws), cells.size))
+
+    print("Closed loop PEEP {:g} to PIP {:g} on the model:".format(args.peep, args.pip))
+    benchmark(a, b, laws, cells, args.kp, args.peep, args.pip)
+
+    write_table(args.output, a, b, ALPHA_UP, args.horizon, args.q, args.r, laws, cells)
+    print("Wrote {}".format(args.output))
@@ -1,123 +1,459 @@
 import serial
-import time 
-import struct 
-import array
-import sys 
+import time
+import struct
+import binascii
+import argparse
+import sys
 import serial.tools.list_ports
 import matplotlib
 import matplotlib.pyplot as plt
 import numpy as np
 
-class CONTROL:
-    def __init__(self, setpoint, pressure, output, timestamp):
-        self.setpoint = setpoint
-        self.pressure = pressure
-        self.output = output
-        self.timestamp = timestamp
+MAGIC_BYTE = 0x5E
+HEADER_SPEC = "<BHHI"    # type, payload length, sequence, timestamp ms
+HEADER_SIZE = 9          # not counting magic byte
+CRC_SIZE = 2
+MAX_PAYLOAD_SIZE = 240
 
+READ_CHUNK_SIZE = 4096
 
-def get_packet(ser, start_time, timeout):
-    step = 0
-    count = 0
-    chk = 0
-    payload = []
+FRAME_RESPONSE = 0x02
+FRAME_TELEMETRY = 0x03
+FRAME_ADC_STREAM = 0x04
+FRAME_TASK_STATS = 0x05
 
+COMMAND_GET_SETTINGS = 0x40
+COMMAND_SET_SETTINGS = 0x41
+COMMAND_GET_GAINS = 0x42
+COMMAND_SET_GAINS = 0x43
+COMMAND_READ_FRAM = 0x44
+COMMAND_GET_STATS = 0x45
+COMMAND_SUBSCRIBE = 0x46
+COMMAND_ADC_STREAM = 0x47
+COMMAND_GET_LATENCY = 0x48
+COMMAND_GET_SCHEDULE = 0x4A
+COMMAND_SET_SCHEDULE = 0x4B
+
+SETTINGS_SPEC = "<BBiiiiii"    # enable, I:E tenths, tidal volume ml, PEEP, PIP, BPM, rise ms, fall ms
+GAINS_SPEC = "<8f"           # kf, kp, ki, kd, integral antiwindup, integral enable range, max, min
+SCHEDULE_ENTRY_SPEC = "<B3f"    # index, kp, ki, kd
+STATS_SPEC = "<9I"           # uptime ms, alarms, dropped frames, rx overflow, rx errors, commands, reset cause, late tasks before reset, uptime ms when late
+# Gain schedule grid, must match gain_schedule.c. Entries are indexed (bpm * PEEP points + peep) * PIP points + pip
+SCHEDULE_PIP_AXIS = [15, 30, 45]
+SCHEDULE_PEEP_AXIS = [5, 15]
+SCHEDULE_BPM_AXIS = [10, 20, 30]
+
+TELEMETRY_RECORD_SPEC = "<HI"    # time offset ms, mask of signals present
+TELEMETRY_RECORD_SIZE = struct.calcsize(TELEMETRY_RECORD_SPEC)
+
+# Signal id: (name, struct format), must match TELEMETRY_SIGNAL in telemetry.h
+SIGNALS = {
+    0: ("adc_raw_0", "H"),
+    1: ("adc_raw_1", "H"),
+    2: ("adc_raw_2", "H"),
+    3: ("adc_raw_3", "H"),
+    4: ("adc_raw_4", "H"),
+    5: ("adc_raw_5", "H"),
+    6: ("adc_raw_6", "H"),
+    7: ("adc_raw_7", "H"),
+    8: ("adc_raw_8", "H"),
+    9: ("pressure", "f"),
+    10: ("setpoint", "f"),
+    11: ("flow_thousand_slpm", "i"),
+    12: ("tidal_volume_l", "f"),
+    13: ("output", "f"),
+    14: ("dac_code", "H"),
+    15: ("alarms", "I"),
+    16: ("control_time_us", "I"),
+    17: ("motor_rpm", "f"),
+    18: ("motor_temp_c", "f"),
+    19: ("motor_temp_predicted_c", "f"),
+    20: ("compliance_ml_cm_h2o", "f"),
+    21: ("resistance_cm_h2o_s_l", "f"),
+    22: ("leak_slpm", "f"),
+}
+SIGNAL_IDS = {name: signal for signal, (name, fmt) in SIGNALS.items()}
+
+TASK_NAME_LENGTH = 10    # configMAX_TASK_NAME_LEN
+TASK_STATS_HEADER_SPEC = "<IB"    # run time since last snapshot us, task count
+TASK_STATS_ENTRY_SPEC = "<{}sBBHH".format(TASK_NAME_LENGTH)    # name, number, priority, CPU share 0.01%, stack high water words
+
+LATENCY_NUM_BUCKETS = 16
+LATENCY_HISTOGRAM_SPEC = "<iHIii{}H".format(LATENCY_NUM_BUCKETS)    # bucket start us, bucket width us, count, min us, max us, buckets
+LATENCY_HISTOGRAMS = ["period jitter", "wake to DAC", "sample to DAC", "wake to output"]
+
+ADC_NUM_CHANNELS = 9
+ADC_BLOCK_HEADER_SPEC = "<HHHB"    # block sequence, ring overruns, missed triggers, scan count
+ADC_BLOCK_HEADER_SIZE = struct.calcsize(ADC_BLOCK_HEADER_SPEC)
+ADC_SCAN_SIZE = 2 * ADC_NUM_CHANNELS
+
+
+class Frame:
+    def __init__(self, frame_type, sequence, timestamp_ms, payload):
+        self.frame_type = frame_type
+        self.sequence = sequence
+        self.timestamp_ms = timestamp_ms
+        self.payload = payload
+
+
+class FrameReader:
+    """ Splits a byte stream into checked frames
+
+    Bytes are fed in chunks of any size. Every valid frame is appended, exactly as
+    received, to the recording file if one is given, so a recording can be fed back
+    through the same reader later.
+    """
+    def __init__(self, recording=None):
+        self.buffer = bytearray()
+        self.recording = recording
+        self.last_sequence = None
+        self.frames_dropped = 0
+        self.crc_errors = 0
+        self.bytes_skipped = 0
+
+    def feed(self, data):
+        """ Returns the list of complete frames after adding data """
+        self.buffer += data
+        frames = []
+        position = 0
+        end = len(self.buffer)
+
+        while True:
+            start = self.buffer.find(MAGIC_BYTE, position)
+            if start < 0:
+                self.bytes_skipped += end - position
+                position = end
+                break
+            self.bytes_skipped += start - position
+            position = start
+
+            if end - start < 1 + HEADER_SIZE:
+                break
+            frame_type, length, sequence, timestamp_ms = struct.unpack_from(HEADER_SPEC, self.buffer, start + 1)
+            if length > MAX_PAYLOAD_SIZE:
+                position = start + 1
+                self.bytes_skipped += 1
+                continue
+
+            frame_end = start + 1 + HEADER_SIZE + length + CRC_SIZE
+            if frame_end > end:
+                break
+
+            crc = self.buffer[frame_end - CRC_SIZE] | (self.buffer[frame_end - 1] << 8)
+            if binascii.crc_hqx(self.buffer[start + 1:frame_end - CRC_SIZE], 0xFFFF) != crc:
+                # Resynchronise on the next magic byte
+                self.crc_errors += 1
+                position = start + 1
+                self.bytes_skipped += 1
+                continue
+
+            if self.last_sequence is not None:
+                self.frames_dropped += (sequence - self.last_sequence - 1) & 0xFFFF
+            self.last_sequence = sequence
+
+            payload = bytes(self.buffer[start + 1 + HEADER_SIZE:frame_end - CRC_SIZE])
+            frames.append(Frame(frame_type, sequence, timestamp_ms, payload))
+            if self.recording:
+                self.recording.write(self.buffer[start:frame_end])
+            position = frame_end
+
+        del self.buffer[:position]
+        return frames
+
+
+def send_command(ser, command, payload=b""):
+    """ Frames and sends a command to the device, answered by a FRAME_RESPONSE """
+    header = struct.pack(HEADER_SPEC, command, len(payload), 0, 0)
+    crc = binascii.crc_hqx(header + payload, 0xFFFF)
+    ser.write(bytes([MAGIC_BYTE]) + header + payload + struct.pack("<H", crc))
+
+
+def subscribe(ser, subscriptions):
+    """ Replaces the device telemetry subscriptions, given as {signal name: decimation} """
+    payload = b"".join(struct.pack("<BH", SIGNAL_IDS[name], decimation) for name, decimation in subscriptions.items())
+    send_command(ser, COMMAND_SUBSCRIBE, payload)
+
+
+def wait_response(ser, reader, command, frames, timeout=0.5):
+    """ Returns (status, data) of the response to command, other frames are added to frames """
+    start_time = time.time()
     while time.time() < start_time + timeout:
-        try:
-            data = ser.read(1)
-        except TypeError:
-            return None
-        if data:
-            data = ord(data)
-
-        if(step == 0 and data == 0x5E):
-            count = 0
-            chk = 0
-            step += 1
-        elif(step == 1):
-            if(count < 12):
-                payload.append(data)
-                count += 1
-                chk += data
-                chk &= 0xFF
-                if count == 12:
-                    step += 1
-        elif(step == 2):
-            if(data == chk):
-                return payload
-            else:
-                print("Checksum wrong")
-                print(data)
-                print(chk)
-                step = 0
-                count = 0
+        for frame in read_frames(ser, reader):
+            if frame.frame_type == FRAME_RESPONSE and frame.payload[0] == command:
+                return (frame.payload[1], frame.payload[2:])
+            frames.append(frame)
+    return None
+
+
+def upload_gain_schedule(ser, reader, frames, path):
+    """ Sends a gain schedule from a CSV of pip, peep, bpm, kp, ki, kd rows on the grid points """
+    entries = {}
+    with open(path, "r") as f:
+        for line in f:
+            fields = line.split("#")[0].strip()
+            if not fields:
+                continue
+            pip, peep, bpm, kp, ki, kd = [float(field) for field in fields.split(",")]
+            index = ((SCHEDULE_BPM_AXIS.index(bpm) * len(SCHEDULE_PEEP_AXIS) + SCHEDULE_PEEP_AXIS.index(peep)) *
+                     len(SCHEDULE_PIP_AXIS) + SCHEDULE_PIP_AXIS.index(pip))
+            entries[index] = (kp, ki, kd)
+
+    expected = len(SCHEDULE_PIP_AXIS) * len(SCHEDULE_PEEP_AXIS) * len(SCHEDULE_BPM_AXIS)
+    if len(entries) != expected:
+        print("Gain schedule has {} of {} grid points, the device only uses a complete schedule".format(len(entries), expected))
+
+    for index, gains in sorted(entries.items()):
+        send_command(ser, COMMAND_SET_SCHEDULE, struct.pack(SCHEDULE_ENTRY_SPEC, index, *gains))
+        response = wait_response(ser, reader, COMMAND_SET_SCHEDULE, frames)
+        if not response or response[0] != 0:
+            print("Gain schedule entry {} rejected".format(index))
+            return False
+    return True
+
+
+def read_frames(ser, reader):
+    """ Reads whatever the port has waiting, blocking for at most the port timeout """
+    data = ser.read(max(1, min(ser.in_waiting, READ_CHUNK_SIZE)))
+    return reader.feed(data)
+
+
+_record_dtypes = {}
+
+
+def record_dtype(mask):
+    """ numpy dtype of a telemetry record holding the signals in mask """
+    if mask not in _record_dtypes:
+        fields = [("time_offset_ms", "<u2"), ("mask", "<u4")]
+        for signal in sorted(SIGNALS):
+            if mask & (1 << signal):
+                name, fmt = SIGNALS[signal]
+                fields.append((name, "<" + fmt))
+        _record_dtypes[mask] = np.dtype(fields)
+    return _record_dtypes[mask]
+
+
+def decode_telemetry(frames):
+    """ Returns {signal name: (times ms, values)} from telemetry frames
+
+    Records are only walked to find their masks, then all records with the same mask
+    are decoded together.
+    """
+    records = {}
+    for frame in frames:
+        payload = frame.payload
+        offset = 0
+        while offset + TELEMETRY_RECORD_SIZE <= len(payload):
+            mask = struct.unpack_from("<I", payload, offset + 2)[0]
+            size = record_dtype(mask).itemsize
+            if offset + size > len(payload):
+                break
+            times, chunks = records.setdefault(mask, ([], []))
+            times.append(frame.timestamp_ms)
+            chunks.append(payload[offset:offset + size])
+            offset += size
+
+    series = {}
+    for mask, (times, chunks) in records.items():
+        dtype = record_dtype(mask)
+        data = np.frombuffer(b"".join(chunks), dtype)
+        times_ms = np.array(times, dtype=np.int64) + data["time_offset_ms"]
+        for name in dtype.names[2:]:
+            series.setdefault(name, []).append((times_ms, data[name]))
+
+    decoded = {}
+    for name, parts in series.items():
+        times_ms = np.concatenate([t for t, v in parts])
+        values = np.concatenate([v for t, v in parts])
+        order = np.argsort(times_ms, kind="stable")
+        decoded[name] = (times_ms[order], values[order])
+    return decoded
+
+
+def decode_task_stats(payload):
+    """ Returns (period us, [(name, number, priority, CPU share %, stack high water words)]) """
+    period_us, count = struct.unpack_from(TASK_STATS_HEADER_SPEC, payload)
+    tasks = []
+    for entry in struct.iter_unpack(TASK_STATS_ENTRY_SPEC, payload[struct.calcsize(TASK_STATS_HEADER_SPEC):]):
+        name, number, priority, share, high_water = entry
+        tasks.append((name.rstrip(b"\0").decode(), number, priority, 0.01 * share, high_water))
+    return (period_us, tasks[:count])
+
+
+def decode_latency(data):
+    """ Returns {histogram name: (bucket edges us, counts, count, min us, max us)} """
+    histograms = {}
+    for name, fields in zip(LATENCY_HISTOGRAMS, struct.iter_unpack(LATENCY_HISTOGRAM_SPEC, data)):
+        start_us, width_us, count, min_us, max_us = fields[:5]
+        edges = start_us + width_us * np.arange(LATENCY_NUM_BUCKETS + 1)
+        histograms[name] = (edges, np.array(fields[5:]), count, min_us, max_us)
+    return histograms
+
+
+def print_latency(histograms):
+    for name, (edges, counts, count, min_us, max_us) in histograms.items():
+        print("Latency {}: {} samples, min {} us, max {} us".format(name, count, min_us, max_us))
+        for low, high, bucket in zip(edges[:-1], edges[1:], counts):
+            if bucket:
+                print("  {:>6} to {:>6} us: {}".format(low, high, bucket))
+
+
+def decode_adc_block(payload):
+    """ Returns (sequence, overruns, missed triggers, scans) from a raw ADC stream block
+
+    The first scan is sent as is, later scans as zig-zag varint deltas per channel.
+    scans is an array of shape (scan count, ADC_NUM_CHANNELS).
+    """
+    sequence, overruns, missed, count = struct.unpack_from(ADC_BLOCK_HEADER_SPEC, payload)
+    first = np.frombuffer(payload, "<u2", ADC_NUM_CHANNELS, ADC_BLOCK_HEADER_SIZE).astype(np.int32)
+
+    if count <= 1:
+        return (sequence, overruns, missed, first.reshape(1, ADC_NUM_CHANNELS))
+
+    data = np.frombuffer(payload, np.uint8, offset=ADC_BLOCK_HEADER_SIZE + ADC_SCAN_SIZE)
+    last = (data & 0x80) == 0
+    # Varint each byte belongs to and the byte position within it
+    varint = np.concatenate(([0], np.cumsum(last)[:-1]))
+    starts = np.flatnonzero(np.concatenate(([True], last[:-1])))
+    shift = 7 * (np.arange(len(data)) - starts[varint])
+    values = np.zeros(len(starts), dtype=np.int64)
+    np.add.at(values, varint, (data & 0x7F).astype(np.int64) << shift)
+    deltas = (values >> 1) ^ -(values & 1)
+
+    deltas = deltas[:(count - 1) * ADC_NUM_CHANNELS].reshape(count - 1, ADC_NUM_CHANNELS)
+    scans = np.vstack((first, first + np.cumsum(deltas, axis=0)))
+    return (sequence, overruns, missed, scans)
+
+
+def decode_adc_stream(frames):
+    """ Returns (scans, compression ratio, blocks dropped, (ring overruns, missed triggers)) """
+    blocks = [decode_adc_block(frame.payload) for frame in frames]
+    if not blocks:
+        return (np.zeros((0, ADC_NUM_CHANNELS), dtype=np.int32), 0.0, 0, (0, 0))
+
+    sequences = np.array([b[0] for b in blocks], dtype=np.int64)
+    blocks_dropped = int(np.sum((np.diff(sequences) - 1) & 0xFFFF))
+    losses = ((blocks[-1][1] - blocks[0][1]) & 0xFFFF, (blocks[-1][2] - blocks[0][2]) & 0xFFFF)
+
+    scans = np.vstack([b[3] for b in blocks])
+    ratio = ADC_SCAN_SIZE * len(scans) / sum(len(frame.payload) for frame in frames)
+    return (scans, ratio, blocks_dropped, losses)
 
 
 if __name__ == "__main__":
 
-    # Figure out the correct port
-    port = ""
-    connected = [comport for comport in serial.tools.list_ports.comports()]
+    parser = argparse.ArgumentParser(description="Low Cost Ventilator USB receiver")
+    parser.add_argument("runtime", type=float, nargs="?", default=15.0, help="capture time in seconds")
+    parser.add_argument("--adc-stream", action="store_true", help="also stream raw ADC scans")
+    parser.add_argument("--latency", action="store_true", help="read and reset the latency histograms after capture")
+    parser.add_argument("--gain-schedule", help="upload a gain schedule CSV of pip, peep, bpm, kp, ki, kd before capture")
+    parser.add_argument("--record", help="append received frames to this file")
+    parser.add_argument("--replay", help="decode a recording instead of the device")
+    args = parser.parse_args()
 
-    for comport in connected:
-        if "ASF" in comport[1]:
-            port = comport[0]
-            break
+    frames = []
+    recording = open(args.record, "ab") if args.record else None
+    reader = FrameReader(recording)
 
-    if port != "":
-        ser = serial.Serial(port, timeout=0.1)  # open serial port
-        print("Connected to Low Cost Ventilator")
+    if args.replay:
+        with open(args.replay, "rb") as f:
+            while True:
+                data = f.read(1 << 20)
+                if not data:
+                    break
+                frames.extend(reader.feed(data))
     else:
-        print("Could not connect to Low Cost Ventilator")
-        sys.exit()
-    
+        # Figure out the correct port
+        port = ""
+        connected = [comport for comport in serial.tools.list_ports.comports()]
 
-    measurements = []
+        for comport in connected:
+            if "ASF" in comport[1]:
+                port = comport[0]
+                break
 
-    start_time = time.time()
+        if port != "":
+            ser = serial.Serial(port, timeout=0.05)  # open serial port
+            print("Connected to Low Cost Ventilator")
+        else:
+            print("Could not connect to Low Cost Ventilator")
+            sys.exit()
 
-    if(len(sys.argv) > 1):
-        runtime = float(sys.argv[1])
-    else:
-        runtime = 15.0
+        if args.gain_schedule:
+            if upload_gain_schedule(ser, reader, frames, args.gain_schedule):
+                print("Gain schedule uploaded")
+
+        if args.adc_stream:
+            send_command(ser, COMMAND_ADC_STREAM, bytes([1]))
 
-    while(time.time() < start_time + runtime):
-        # get payload
-        payload = get_packet(ser, time.time(), 0.1)
-        if payload:
-            # unpack it
-            line_spec = "<iif"
-            info = struct.unpack(line_spec, array.array('B',payload).tostring())
+        # Only split and check frames while capturing, decode everything afterwards
+        start_time = time.time()
+        while(time.time() < start_time + args.runtime):
+            frames.extend(read_frames(ser, reader))
 
-            measurements.append(CONTROL(pressure=info[0],setpoint=info[1],output=info[2],timestamp=time.time()))
+        if args.adc_stream:
+            send_command(ser, COMMAND_ADC_STREAM, bytes([0]))
+
+        if args.latency:
+            send_command(ser, COMMAND_GET_LATENCY, bytes([1]))
+            response = wait_response(ser, reader, COMMAND_GET_LATENCY, frames)
+            if response:
+                print_latency(decode_latency(response[1]))
+            else:
+                print("No latency response")
+
+        ser.close()             # close port
+
+    if recording:
+        recording.close()
 
-    ser.close()             # close port
     print("Readings complete")
-    print("Readings received: {}".format(len(measurements)))
+    print("Frames received: {}".format(len(frames)))
+    print("Frames dropped: {}".format(reader.frames_dropped))
+    print("CRC errors: {}".format(reader.crc_errors))
+
+    stats_frames = [frame for frame in frames if frame.frame_type == FRAME_TASK_STATS]
+    if stats_frames:
+        period_us, tasks = decode_task_stats(stats_frames[-1].payload)
+        print("Task stats over the last {:.3f} s:".format(1e-6 * period_us))
+        print("  {:<10} {:>3} {:>4} {:>7} {:>11}".format("task", "#", "prio", "CPU %", "stack free"))
+        for name, number, priority, share, high_water in sorted(tasks, key=lambda t: -t[3]):
+            print("  {:<10} {:>3} {:>4} {:>7.2f} {:>11}".format(name, number, priority, share, high_water))
+
+    adc_frames = [frame for frame in frames if frame.frame_type == FRAME_ADC_STREAM]
+    if adc_frames:
+        scans, ratio, blocks_dropped, losses = decode_adc_stream(adc_frames)
+        print("ADC scans received: {}".format(len(scans)))
+        print("ADC compression ratio: {:.2f}".format(ratio))
+        print("ADC blocks dropped: {}".format(blocks_dropped))
+        print("ADC scans lost on device: {} ring overruns, {} missed triggers".format(*losses))
+
+    measurements = decode_telemetry([frame for frame in frames if frame.frame_type == FRAME_TELEMETRY])
+    print("Readings received: {}".format(sum(len(times) for times, values in measurements.values())))
+    if not measurements:
+        sys.exit()
+    t0 = min(times[0] for times, values in measurements.values())
 
-    times_s = np.array([m.timestamp for m in measurements])
-    times_s = times_s - times_s[0]
-    pressure = np.array([m.pressure for m in measurements])
-    setpoint = np.array([m.setpoint for m in measurements])
-    output = np.array([m.output for m in measurements])
+    def series(name):
+        times, values = measurements.get(name, (np.array([t0]), np.array([np.nan])))
+        return 0.001 * (times - t0), values
 
     fig, ax = plt.subplots()
     plt.subplot(2,1,1)
-    plt.plot(times_s, pressure, '.-',label='Measured')
-    plt.plot(times_s, setpoint, '.-',label='Desired')
+    plt.plot(*series("pressure"), '.-',label='Measured')
+    plt.plot(*series("setpoint"), '.-',label='Desired')
     plt.legend()
     plt.grid()
     plt.ylabel('Pressure, cmH20')
     plt.subplot(2,1,2)
-    plt.plot(times_s, output, '.-',label='Output')
+    plt.plot(*series("output"), '.-',label='Output')
     plt.ylabel('Output')
     plt.legend()
     plt.grid()
 
     fig, ax = plt.subplots()
-    ax.plot(times_s, pressure, '.-',label='Measured')
-    ax.plot(times_s, output, '.-',label='Output')
+    ax.plot(*series("pressure"), '.-',label='Measured')
+    ax.plot(*series("output"), '.-',label='Output')
     ax.legend()
     ax.grid()
 
-    plt.show()
\ No newline at end of file
+    plt.show()
@@ -0,0 +1,42 @@
+import argparse
+import math
+
+# Defaults match the motor NTC divider, the table goes in LCV/src/lib/adc_interface.c
+ADC_COUNTS = 4096
+TABLE_STEP = 64
+TEMP_MIN_C = -40.0
+TEMP_MAX_C = 150.0
+
+
+def ntc_celsius(raw, beta, r25, pullup):
+    """Beta equation for an NTC to ground under a pull-up to the ADC reference"""
+    if raw <= 0:
+        return TEMP_MAX_C
+    if raw >= ADC_COUNTS - 1:
+        return TEMP_MIN_C
+    resistance = pullup * raw / (ADC_COUNTS - 1 - raw)
+    kelvin = 1.0 / (1.0 / 298.15 + math.log(resistance / r25) / beta)
+    return min(max(kelvin - 273.15, TEMP_MIN_C), TEMP_MAX_C)
+
+
+def table(beta, r25, pullup, step):
+    return [int(round(10.0 * ntc_celsius(raw, beta, r25, pullup))) for raw in range(0, ADC_COUNTS + 1, step)]
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Generate the motor NTC lookup table for adc_interface.c")
+    parser.add_argument("--beta", type=float, default=3950.0, help="NTC Beta, K")
+    parser.add_argument("--r25", type=float, default=10000.0, help="NTC resistance at 25 C, ohm")
+    parser.add_argument("--pullup", type=float, default=10000.0, help="pull-up resistance, ohm")
+    parser.add_argument("--step", type=int, default=TABLE_STEP, help="ADC counts between entries, power of two")
+    args = parser.parse_args()
+
+    values = table(args.beta, args.r25, args.pullup, args.step)
+    print(" // Tenths of a degree C every {} counts, from Interface/ntc_table.py --beta {:g} --r25 {:g} --pullup {:g}".format(
+        args.step, args.beta, args.r25, args.pullup))
+    print(" static const int16_t ntc_table_decidegrees[MOTOR_NTC_TABLE_SIZE] =")
+    print(" {")
+    for i in range(0, len(values), 8):
+        print("\t" + " ".join("{},".format(v) for v in values[i:i + 8]))
+    print(" };")
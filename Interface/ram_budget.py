@@ -0,0 +1,98 @@
+import re
+import argparse
+import sys
+import os
+
+# Output sections that take RAM on the SAMD21
+RAM_REGION = "ram"
+TOP_CONTRIBUTORS = 20
+
+MEMORY_LINE = re.compile(r"^(\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)")
+SECTION_LINE = re.compile(r"^(\.\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+(.*))?$")
+INPUT_LINE = re.compile(r"^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$")
+
+
+def read_map(path):
+    """Returns the RAM region (origin, length), the RAM output sections and the input sections in them"""
+    with open(path, "r") as f:
+        lines = f.read().splitlines()
+
+    ram = None
+    i = lines.index("Memory Configuration") if "Memory Configuration" in lines else 0
+    for line in lines[i:]:
+        match = MEMORY_LINE.match(line)
+        if match and match.group(1) == RAM_REGION:
+            ram = (int(match.group(2), 16), int(match.group(3), 16))
+            break
+        if line.startswith("Linker script and memory map"):
+            break
+    if ram is None:
+        raise ValueError("no '{}' region in {}".format(RAM_REGION, path))
+
+    def in_ram(address):
+        return ram[0] <= address < ram[0] + ram[1]
+
+    sections = []
+    contributors = []
+    current = None
+    pending = None
+    for line in lines:
+        # Long section names are printed alone with the address on the next line
+        if pending is not None:
+            line = pending + line
+            pending = None
+        elif re.match(r"^ ?\.\S+$", line) or re.match(r"^ COMMON$", line):
+            pending = line
+            continue
+
+        if line.startswith("."):
+            match = SECTION_LINE.match(line)
+            current = None
+            if match and match.group(1):
+                address, size = int(match.group(2), 16), int(match.group(3), 16)
+                if size and in_ram(address):
+                    current = match.group(1)
+                    sections.append((current, address, size))
+        elif current and line.startswith(" "):
+            match = INPUT_LINE.match(line)
+            if match and match.group(1):
+                address, size = int(match.group(2), 16), int(match.group(3), 16)
+                if size and in_ram(address):
+                    contributors.append((match.group(1), size, os.path.basename(match.group(4).strip())))
+
+    return ram, sections, contributors
+
+
+def report(ram, sections, contributors, top=TOP_CONTRIBUTORS):
+    used = sum(size for _, _, size in sections)
+    print("RAM budget: {} of {} bytes used ({:.1f} %), {} free".format(used, ram[1], 100.0 * used / ram[1], ram[1] - used))
+    for name, address, size in sections:
+        print("  {:<12} 0x{:08x} {:>7}".format(name, address, size))
+
+    print("Largest RAM objects:")
+    for name, size, obj in sorted(contributors, key=lambda c: -c[1])[:top]:
+        print("  {:>7}  {:<40} {}".format(size, name, obj))
+
+    per_object = {}
+    for _, size, obj in contributors:
+        per_object[obj] = per_object.get(obj, 0) + size
+    print("RAM by object file:")
+    for obj, size in sorted(per_object.items(), key=lambda c: -c[1])[:top]:
+        print("  {:>7}  {}".format(size, obj))
+    return used
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Report RAM use from the linker map and check it against a budget")
+    parser.add_argument("map", help="linker map file, e.g. LCV/Debug/LCV.map")
+    parser.add_argument("--limit", type=int, default=None, help="fail if total RAM use, stacks included, exceeds this many bytes")
+    parser.add_argument("--top", type=int, default=TOP_CONTRIBUTORS, help="number of largest objects to list")
+    args = parser.parse_args()
+
+    ram, sections, contributors = read_map(args.map)
+    used = report(ram, sections, contributors, args.top)
+
+    if args.limit is not None and used > args.limit:
+        print("error: RAM use of {} bytes exceeds the budget of {} bytes".format(used, args.limit))
+        sys.exit(1)
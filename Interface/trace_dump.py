@@ -0,0 +1,134 @@
+import serial
+import time
+import struct
+import json
+import argparse
+import sys
+import serial.tools.list_ports
+
+import interface
+
+COMMAND_TRACE = 0x49
+FRAME_TRACE = 0x06
+
+TRACE_STOP = 0
+TRACE_START = 1
+TRACE_DUMP = 2
+
+DUMP_TASKS = 0
+DUMP_EVENTS = 1
+DUMP_END = 2
+
+EVENT_SPEC = "<IBBH"    # time us, event, reserved, object
+TASK_SPEC = "<H{}s".format(interface.TASK_NAME_LENGTH)    # object, name
+
+# Must match TRACE_EVENT in trace.h
+TASK_SWITCHED_IN = 0
+EVENT_NAMES = {
+    1: "queue send",
+    2: "queue receive",
+    3: "queue send from ISR",
+    4: "queue receive from ISR",
+    5: "blocked on queue send",
+    6: "blocked on queue receive",
+    7: "notify",
+    8: "notify from ISR",
+    9: "ISR",
+}
+TASK_EVENTS = (TASK_SWITCHED_IN, 7, 8)
+ISR_EVENT = 9
+ISR_NAMES = {0: "ADC", 1: "USB RX"}
+ISR_TID = 0
+
+
+def read_dump(ser, reader, timeout=5.0):
+    """ Returns ({task object: name}, [(time us, event, object)], events overwritten) """
+    tasks = {}
+    events = []
+    start_time = time.time()
+    while time.time() < start_time + timeout:
+        for frame in interface.read_frames(ser, reader):
+            if frame.frame_type != FRAME_TRACE:
+                continue
+            record = frame.payload[0]
+            if record == DUMP_TASKS:
+                for task, name in struct.iter_unpack(TASK_SPEC, frame.payload[1:]):
+                    tasks[task] = name.rstrip(b"\0").decode()
+            elif record == DUMP_EVENTS:
+                for time_us, event, reserved, obj in struct.iter_unpack(EVENT_SPEC, frame.payload[5:]):
+                    events.append((time_us, event, obj))
+            elif record == DUMP_END:
+                count, overwritten = struct.unpack_from("<II", frame.payload, 1)
+                if count != len(events):
+                    print("Trace frames lost: {} of {} events received".format(len(events), count))
+                return (tasks, events, overwritten)
+    return (tasks, events, 0)
+
+
+def to_chrome_trace(tasks, events):
+    """ Converts a dump to the Chrome trace event format, one thread row per task """
+    trace = [{"name": "thread_name", "ph": "M", "pid": 0, "tid": ISR_TID, "args": {"name": "ISR"}}]
+    for task, name in tasks.items():
+        trace.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": task, "args": {"name": name}})
+
+    # Unwrap the 32 bit microsecond counter
+    times = []
+    offset = 0
+    for i, (time_us, event, obj) in enumerate(events):
+        if i > 0 and time_us < events[i - 1][0]:
+            offset += 1 << 32
+        times.append(time_us + offset)
+
+    running = None
+    running_since = None
+    for ts, (time_us, event, obj) in zip(times, events):
+        if event == TASK_SWITCHED_IN:
+            if running is not None:
+                trace.append({"name": tasks.get(running, hex(running)), "ph": "X", "pid": 0, "tid": running,
+                              "ts": running_since, "dur": ts - running_since})
+            running = obj
+            running_since = ts
+        elif event == ISR_EVENT:
+            trace.append({"name": ISR_NAMES.get(obj, str(obj)), "ph": "i", "s": "t", "pid": 0, "tid": ISR_TID, "ts": ts})
+        else:
+            target = tasks.get(obj, hex(obj)) if event in TASK_EVENTS else hex(obj)
+            tid = running if running is not None else ISR_TID
+            trace.append({"name": "{} {}".format(EVENT_NAMES.get(event, event), target), "ph": "i", "s": "t",
+                          "pid": 0, "tid": tid, "ts": ts})
+    return {"traceEvents": trace, "displayTimeUnit": "ms"}
+
+
+if __name__ == "__main__":
+
+    parser = argparse.ArgumentParser(description="Record a FreeRTOS trace and convert it for chrome://tracing or Perfetto")
+    parser.add_argument("duration", type=float, nargs="?", default=0.05, help="recording time in seconds")
+    parser.add_argument("--output", default="trace.json", help="Chrome trace JSON file to write")
+    args = parser.parse_args()
+
+    # Figure out the correct port
+    port = ""
+    connected = [comport for comport in serial.tools.list_ports.comports()]
+
+    for comport in connected:
+        if "ASF" in comport[1]:
+            port = comport[0]
+            break
+
+    if port != "":
+        ser = serial.Serial(port, timeout=0.05)  # open serial port
+        print("Connected to Low Cost Ventilator")
+    else:
+        print("Could not connect to Low Cost Ventilator")
+        sys.exit()
+
+    reader = interface.FrameReader()
+    interface.send_command(ser, COMMAND_TRACE, bytes([TRACE_START]))
+    time.sleep(args.duration)
+    interface.send_command(ser, COMMAND_TRACE, bytes([TRACE_DUMP]))
+    tasks, events, overwritten = read_dump(ser, reader)
+    ser.close()
+
+    print("Events: {}, overwritten: {}".format(len(events), overwritten))
+    with open(args.output, "w") as f:
+        json.dump(to_chrome_trace(tasks, events), f)
+    print("Wrote {}".format(args.output))
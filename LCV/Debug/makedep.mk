@@ -38,28 +38,60 @@ src\ASF\thirdparty\freertos\freertos-10.0.0\Source\event_groups.c
 
 src\ASF\thirdparty\freertos\freertos-10.0.0\Source\portable\GCC\ARM_CM0\port.c
 
-src\ASF\thirdparty\freertos\freertos-10.0.0\Source\portable\MemMang\heap_4.c
-
 src\lib\adc_interface.c
 
+src\lib\adc_stream.c
+
 src\lib\alarm_monitoring.c
 
 src\lib\controller.c
 
 src\lib\crc8.c
 
+src\lib\crcccitt.c
+
+src\lib\empc.c
+
+src\lib\feedforward.c
+
 src\lib\flow_sensor_fs6122.c
 
 src\lib\fm25l16b.c
 
+src\lib\gain_schedule.c
+
+src\lib\heartbeat.c
+
+src\lib\ilc.c
+
+src\lib\latency.c
+
 src\lib\lcd_interface.c
 
+src\lib\lung_mechanics.c
+
 src\lib\motor_interface.c
 
+src\lib\motor_speed.c
+
+src\lib\motor_thermal.c
+
+src\lib\setting_input.c
+
+src\lib\smith_predictor.c
+
 src\lib\spi_interface.c
 
+src\lib\telemetry.c
+
+src\lib\timebase.c
+
+src\lib\trace.c
+
 src\lib\usb_interface.c
 
+src\task_command.c
+
 src\task_control.c
 
 src\task_hmi.c
@@ -41,8 +41,10 @@ void system_board_init(void);
 #define MOTOR_NTC_GPIO				IOPORT_CREATE_PIN(IOPORT_PORTB, 8)
 #define MOTOR_NTC_GPIO_FLAGS		(IOPORT_MODE_MUX_B)
 #define MOTOR_READY_GPIO			IOPORT_CREATE_PIN(IOPORT_PORTA, 1)
-#define MOTOR_SPEED_GPIO			IOPORT_CREATE_PIN(IOPORT_PORTA, 2)
+#define MOTOR_SPEED_GPIO			IOPORT_CREATE_PIN(IOPORT_PORTA, 2)	// DAC VOUT, speed command to the driver
 #define MOTOR_SPEED_GPIO_FLAGS		(IOPORT_MODE_MUX_B)
+#define MOTOR_TACH_GPIO				IOPORT_CREATE_PIN(IOPORT_PORTA, 18)	// EXTINT2, driver speed output
+#define MOTOR_TACH_GPIO_FLAGS		(IOPORT_MODE_MUX_A)
 
 // Control input
 #define INPUT_POTENTIOMETER_GPIO			IOPORT_CREATE_PIN(IOPORT_PORTB,9)
@@ -50,6 +52,11 @@ void system_board_init(void);
 #define INPUT_PUSHBUTTON_GPIO				IOPORT_CREATE_PIN(IOPORT_PORTA, 12)
 #define INPUT_ENABLE_GPIO					IOPORT_CREATE_PIN(IOPORT_PORTB, 11)
 
+// Optional quadrature encoder in place of the potentiometer, set to 1 when fitted
+#define INPUT_KNOB_IS_ENCODER				0
+#define INPUT_ENCODER_A_GPIO				IOPORT_CREATE_PIN(IOPORT_PORTB, 10)	// EXTINT10
+#define INPUT_ENCODER_B_GPIO				IOPORT_CREATE_PIN(IOPORT_PORTA, 20)	// EXTINT4
+
 // Pressure sensors
 #define PRESSURE_SENSOR_0_GPIO				IOPORT_CREATE_PIN(IOPORT_PORTA,4)
 #define PRESSURE_SENSOR_0_GPIO_FLAGS		(IOPORT_MODE_MUX_B)
@@ -57,7 +57,6 @@
 #define configTICK_RATE_HZ						( 1000 )
 #define configMAX_PRIORITIES					( 5 )
 #define configMINIMAL_STACK_SIZE				( ( unsigned short ) 130 )
-#define configTOTAL_HEAP_SIZE					( ( size_t ) ( 12000 ) )
 #define configMAX_TASK_NAME_LEN					( 10 )
 #define configUSE_TRACE_FACILITY				1
 #define configUSE_16_BIT_TICKS					0
@@ -66,17 +65,41 @@
 #define configQUEUE_REGISTRY_SIZE				8
 #define configCHECK_FOR_STACK_OVERFLOW			2
 #define configUSE_RECURSIVE_MUTEXES				1
-#define configUSE_MALLOC_FAILED_HOOK			1
+#define configUSE_MALLOC_FAILED_HOOK			0
 #define configUSE_APPLICATION_TASK_TAG			0
 #define configUSE_COUNTING_SEMAPHORES			1
 
+/* Every kernel object lives in static storage, so RAM use is fixed at link time.
+The idle and timer task memory comes from main.c. There is no heap. */
+#define configSUPPORT_STATIC_ALLOCATION			1
+#define configSUPPORT_DYNAMIC_ALLOCATION		0
+
 /* The full demo always has tasks to run so the tick will never be turned off.
 The blinky demo will use the default tickless idle implementation to turn the
 tick off. */
 #define configUSE_TICKLESS_IDLE					0
 
 /* Run time stats gathering definitions. */
-#define configGENERATE_RUN_TIME_STATS	0
+#define configGENERATE_RUN_TIME_STATS	1
+#ifndef __IAR_SYSTEMS_ASM__
+	/* 1 MHz TC counter, see lib/timebase.c */
+	#include "lib/timebase.h"
+	#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()	timebase_init()
+	#define portGET_RUN_TIME_COUNTER_VALUE()			get_time_us()
+
+	/* RAM ring trace recorder, see lib/trace.c */
+	#include "lib/trace.h"
+	#define traceTASK_SWITCHED_IN()						trace_record(TRACE_TASK_SWITCHED_IN, TRACE_OBJECT_ID(pxCurrentTCB))
+	#define traceQUEUE_SEND( pxQueue )					trace_record(TRACE_QUEUE_SEND, TRACE_OBJECT_ID(pxQueue))
+	#define traceQUEUE_RECEIVE( pxQueue )				trace_record(TRACE_QUEUE_RECEIVE, TRACE_OBJECT_ID(pxQueue))
+	#define traceQUEUE_SEND_FROM_ISR( pxQueue )			trace_record(TRACE_QUEUE_SEND_FROM_ISR, TRACE_OBJECT_ID(pxQueue))
+	#define traceQUEUE_RECEIVE_FROM_ISR( pxQueue )		trace_record(TRACE_QUEUE_RECEIVE_FROM_ISR, TRACE_OBJECT_ID(pxQueue))
+	#define traceBLOCKING_ON_QUEUE_SEND( pxQueue )		trace_record(TRACE_BLOCKING_ON_QUEUE_SEND, TRACE_OBJECT_ID(pxQueue))
+	#define traceBLOCKING_ON_QUEUE_RECEIVE( pxQueue )	trace_record(TRACE_BLOCKING_ON_QUEUE_RECEIVE, TRACE_OBJECT_ID(pxQueue))
+	#define traceTASK_NOTIFY()							trace_record(TRACE_TASK_NOTIFY, TRACE_OBJECT_ID(pxTCB))
+	#define traceTASK_NOTIFY_FROM_ISR()					trace_record(TRACE_TASK_NOTIFY_FROM_ISR, TRACE_OBJECT_ID(pxTCB))
+	#define traceTASK_NOTIFY_GIVE_FROM_ISR()			trace_record(TRACE_TASK_NOTIFY_FROM_ISR, TRACE_OBJECT_ID(pxTCB))
+#endif
 
 /* This demo makes use of one or more example stats formatting functions.  These
 format the raw data provided by the uxTaskGetSystemState() function in to human
@@ -92,7 +115,7 @@ FreeRTOS/Source/tasks.c for limitations. */
 #define configUSE_TIMERS				1
 #define configTIMER_TASK_PRIORITY		( configMAX_PRIORITIES - 1 )
 #define configTIMER_QUEUE_LENGTH		10
-#define configTIMER_TASK_STACK_DEPTH	( configMINIMAL_STACK_SIZE * 5 )
+#define configTIMER_TASK_STACK_DEPTH	( configMINIMAL_STACK_SIZE * 2 )	/* Callbacks only notify tasks */
 
 /* Set the following definitions to 1 to include the API function, or zero
 to exclude the API function. */
@@ -116,7 +116,6 @@
 //! Interface callback definition
 //#define  UDI_CDC_ENABLE_EXT(port)          true
 //#define  UDI_CDC_DISABLE_EXT(port)
-#define  UDI_CDC_RX_NOTIFY(port)
 #define  UDI_CDC_TX_EMPTY_NOTIFY(port)
 #define  UDI_CDC_SET_CODING_EXT(port,cfg)
 #define  UDI_CDC_SET_DTR_EXT(port,set)
@@ -126,6 +125,8 @@
 extern bool my_callback_cdc_enable(void);
 #define UDI_CDC_DISABLE_EXT(port) my_callback_cdc_disable()
 extern void my_callback_cdc_disable(void);
+#define UDI_CDC_RX_NOTIFY(port) my_callback_rx_notify(port)
+extern void my_callback_rx_notify(uint8_t port);
 // #define  UDI_CDC_RX_NOTIFY(port) my_callback_rx_notify(port)
 // extern void my_callback_rx_notify(uint8_t port);
 // #define  UDI_CDC_TX_EMPTY_NOTIFY(port) my_callback_tx_empty_notify(port)
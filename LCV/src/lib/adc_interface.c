@@ -29,27 +29,51 @@ SOFTWARE.*/
 
  #include "../task_monitor.h"
 
+ #include "adc_stream.h"
  #include "alarm_monitoring.h"
+ #include "latency.h"
+ #include "motor_interface.h"
+ #include "trace.h"
+ #include "telemetry.h"
 
  #include "adc_interface.h"
 
- #define ADC_BUFFER_SIZE		(9)
  #define ADC_MAX				(4095.0)
 
+ // Tenths of a degree C every 64 counts, from Interface/ntc_table.py --beta 3950 --r25 10000 --pullup 10000
+ static const int16_t ntc_table_decidegrees[MOTOR_NTC_TABLE_SIZE] =
+ {
+	1500, 1500, 1293, 1127, 1016, 933, 866, 811,
+	763, 722, 685, 651, 621, 593, 567, 542,
+	520, 498, 477, 457, 439, 420, 403, 386,
+	369, 353, 338, 323, 308, 293, 278, 264,
+	250, 236, 222, 208, 194, 181, 167, 153,
+	139, 125, 111, 97, 82, 68, 53, 37,
+	22, 5, -12, -29, -47, -67, -87, -109,
+	-132, -158, -186, -219, -257, -303, -365, -400,
+	-400,
+ };
+
  static struct adc_module adc_module_instance;
- static volatile uint16_t adc_buffer[ADC_BUFFER_SIZE];
+ static volatile uint16_t adc_buffer[ADC_NUM_CHANNELS];
 
  static volatile float pressure_raw_filt[3];
  static volatile uint16_t potentiometer_meas_raw;
  static volatile uint16_t motor_temp_meas_raw;
  static volatile uint16_t flow_meas_raw;
+ static volatile float pressure_voted = 0.0;
+ static volatile uint8_t overpressure_votes = 0;
 
  static volatile bool setup = false;
+ static volatile bool scan_done = false;
 
  static void adc_cb(struct adc_module *const module)
  {
 	if(adc_get_job_status(module, ADC_JOB_READ_BUFFER) == STATUS_OK)
 	{
+		latency_mark_from_isr(LATENCY_ADC_DONE);
+		trace_record(TRACE_ISR_ENTER, TRACE_ISR_ADC);
+
 		// Motor first
 		motor_temp_meas_raw = adc_buffer[0];
 		// Control potentiometer
@@ -60,9 +84,48 @@ SOFTWARE.*/
 		pressure_raw_filt[2] = (0.9 * pressure_raw_filt[2]) + (0.1) * adc_buffer[4];
 		// Flow sensor at ain[10]
 		flow_meas_raw = adc_buffer[8];
+
+		adc_stream_push(adc_buffer);
+		scan_done = true;
+	}
+
+	overpressure_votes = 0;
+ }
+
+ /*
+ *	\brief Window monitor callback, a conversion was above the overpressure limit
+ *
+ *	Cuts the motor directly from the interrupt once enough pressure sensors agree
+ */
+ static void adc_window_cb(struct adc_module *const module)
+ {
+	// The result of this conversion was stored just before, in the same interrupt
+	int32_t channel = (module->job_buffer - adc_buffer) - 1;
+
+	if(channel >= ADC_PRESSURE_FIRST_CHANNEL && channel < ADC_PRESSURE_FIRST_CHANNEL + NUM_PRESSURE_SENSOR_CHANNELS)
+	{
+		// One noisy sample must not stop ventilation
+		if(++overpressure_votes >= OVERPRESSURE_VOTES)
+		{
+			motor_overpressure_cutoff();
+		}
 	}
  }
 
+ /*
+ *	\brief Converts a pressure to the raw ADC reading, the inverse of get_pressure_sensor_cmH2O
+ *
+ *	\param pressure_cmH2O The pressure in cm-H2O
+ *
+ *	\return The ADC reading
+ */
+ static int32_t pressure_cmH2O_to_raw(float pressure_cmH2O)
+ {
+	float pressure_psi = pressure_cmH2O / 70.307;
+	float pressure_voltage_scaled_up = (4.0 * pressure_psi / 5.0) + 0.5;
+	return (int32_t) (ADC_MAX * (pressure_voltage_scaled_up * (10.0 / 15.6)) / 3.3);
+ }
+
  /*
  *	\brief Sets up ADC interface
  */
@@ -84,12 +147,25 @@ SOFTWARE.*/
 	config.pin_scan.offset_start_scan = 0;
 	config.pin_scan.inputs_to_scan = 9;
 
+	// Window monitor checks every conversion, the callback picks out the pressure channels
+	config.window.window_mode = ADC_WINDOW_MODE_ABOVE_LOWER;
+	config.window.window_lower_value = pressure_cmH2O_to_raw(OVERPRESSURE_LIMIT_CM_H2O);
+
 	adc_init(&adc_module_instance, ADC, &config);
 	adc_enable(&adc_module_instance);
 
 	// Handle all conversions in callbacks
 	adc_register_callback(&adc_module_instance, adc_cb, ADC_CALLBACK_READ_BUFFER);
 	adc_enable_callback(&adc_module_instance, ADC_CALLBACK_READ_BUFFER);
+	adc_register_callback(&adc_module_instance, adc_window_cb, ADC_CALLBACK_WINDOW);
+	adc_enable_callback(&adc_module_instance, ADC_CALLBACK_WINDOW);
+
+	uint8_t i;
+	for(i = 0; i < ADC_NUM_CHANNELS; i++)
+	{
+		telemetry_register(TELEMETRY_ADC_RAW_0 + i, TELEMETRY_U16, &adc_buffer[i]);
+	}
+	telemetry_register(TELEMETRY_PRESSURE_VOTED, TELEMETRY_FLOAT, &pressure_voted);
 
 	setup = true;
 
@@ -102,10 +178,24 @@ SOFTWARE.*/
 	// Trigger new measurement
 	if(setup)
 	{
-		adc_read_buffer_job(&adc_module_instance, adc_buffer, ADC_BUFFER_SIZE);
+		if(adc_read_buffer_job(&adc_module_instance, adc_buffer, ADC_NUM_CHANNELS) == STATUS_BUSY)
+		{
+			// Previous scan has not finished
+			adc_stream_count_missed_scan();
+		}
 	}
  }
 
+ /*
+ *	\brief Checks if a full scan has completed since start, before then the readings are zero
+ *
+ *	\return True once readings are valid
+ */
+ bool adc_has_scanned(void)
+ {
+	return scan_done;
+ }
+
  /*
  *	\brief Gets pressure sensor data
  *
@@ -185,6 +275,7 @@ SOFTWARE.*/
 	{
 		set_alarm(ALARM_PRESSURE_SENSOR, false);
 	}
+	pressure_voted = avg_pressure;
 	return avg_pressure;
  }
 
@@ -205,8 +296,14 @@ SOFTWARE.*/
  */
  float get_motor_temp_celsius(void)
  {
-	// TODO what is scale?
-	return 0.0;
+	// NTC to ground under a 10K pull-up, an open sensor reads cold and a short reads hot
+	uint16_t raw = motor_temp_meas_raw;
+	uint16_t index = raw / MOTOR_NTC_TABLE_STEP;
+	uint16_t fraction = raw % MOTOR_NTC_TABLE_STEP;
+
+	int32_t low = ntc_table_decidegrees[index];
+	int32_t high = ntc_table_decidegrees[index + 1];
+	return 0.1 * (low + ((high - low) * (int32_t) fraction) / (float) MOTOR_NTC_TABLE_STEP);
  }
 
  /*
@@ -31,9 +31,18 @@ SOFTWARE.*/
 #define ADC_INTERFACE_H_
 
 #define NUM_PRESSURE_SENSOR_CHANNELS		3
+#define ADC_NUM_CHANNELS					(9)	// Scan length
+#define ADC_PRESSURE_FIRST_CHANNEL			(2)	// Pressure sensors are consecutive in the scan
+
+#define OVERPRESSURE_LIMIT_CM_H2O			(60.0)	// Hardware motor cutoff, well above the highest PIP setting
+#define OVERPRESSURE_VOTES					(2)		// Sensors over the limit in one scan to trip
+
+#define MOTOR_NTC_TABLE_STEP				(64)	// ADC counts between lookup table entries
+#define MOTOR_NTC_TABLE_SIZE				(4096 / MOTOR_NTC_TABLE_STEP + 1)
 
 void adc_interface_init(void);
 void adc_request_update(void);
+bool adc_has_scanned(void);
 float get_pressure_sensor_cmH2O(uint8_t channel);
 float get_pressure_sensor_cmH2O_voted(void);
 float get_input_potentiometer_portion(void);
@@ -0,0 +1,193 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file adc_stream.c
+ *
+ * \brief Compressed raw ADC scan streaming for diagnostics
+ *
+ *	Each block starts with one scan sent as is, so a dropped block costs only its own
+ *	scans. Following scans are sent as the zig-zag varint of the difference from the
+ *	previous scan, per channel.
+ */
+
+ #include "../task_monitor.h"
+
+ #include "adc_interface.h"
+ #include "usb_interface.h"
+
+ #include "adc_stream.h"
+
+ typedef struct
+ {
+	uint16_t channel[ADC_NUM_CHANNELS];
+	uint32_t time_ms;
+ } adc_scan_t;
+
+ static volatile bool stream_enabled = false;
+
+ // Filled from the ADC interrupt, emptied by adc_stream_process
+ static adc_scan_t scan_ring[ADC_STREAM_RING_SCANS];
+ static volatile uint32_t ring_head = 0;
+ static volatile uint32_t ring_tail = 0;
+ static volatile uint16_t ring_overrun_count = 0;
+ static volatile uint16_t missed_scan_count = 0;
+
+ static uint8_t block[USB_FRAME_MAX_PAYLOAD_SIZE];
+ static uint16_t block_length = 0;
+ static uint8_t block_scan_count = 0;
+ static uint16_t block_sequence = 0;
+ static uint32_t block_start_ms = 0;
+ static uint16_t last_scan[ADC_NUM_CHANNELS];
+
+ /*
+ *	\brief Starts or stops streaming
+ *
+ *	\param enable True to stream
+ */
+ void adc_stream_enable(bool enable)
+ {
+	stream_enabled = enable;
+ }
+
+ bool adc_stream_is_enabled(void)
+ {
+	return stream_enabled;
+ }
+
+ /*
+ *	\brief Queues a completed scan
+ *
+ *	\param scan Pointer to ADC_NUM_CHANNELS results in scan order
+ */
+ void adc_stream_push(volatile uint16_t * scan)
+ {
+	// WARNING: ISR context
+	uint8_t i;
+
+	if(!stream_enabled)
+	{
+		return;
+	}
+
+	if((ring_head - ring_tail) >= ADC_STREAM_RING_SCANS)
+	{
+		ring_overrun_count++;
+		return;
+	}
+
+	adc_scan_t * slot = &scan_ring[ring_head % ADC_STREAM_RING_SCANS];
+	for(i = 0; i < ADC_NUM_CHANNELS; i++)
+	{
+		slot->channel[i] = scan[i];
+	}
+	slot->time_ms = xTaskGetTickCountFromISR() * portTICK_PERIOD_MS;
+	ring_head++;
+ }
+
+ /*
+ *	\brief Counts a scan trigger that found the ADC still busy
+ */
+ void adc_stream_count_missed_scan(void)
+ {
+	if(stream_enabled)
+	{
+		missed_scan_count++;
+	}
+ }
+
+ static uint8_t encode_varint(int32_t delta, uint8_t * buff)
+ {
+	uint32_t value = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+	uint8_t length = 0;
+
+	while(value >= 0x80)
+	{
+		buff[length++] = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+	buff[length++] = (uint8_t) value;
+	return length;
+ }
+
+ static void send_block(void)
+ {
+	if(block_scan_count > 0)
+	{
+		block[6] = block_scan_count;
+		usb_send_frame(USB_FRAME_ADC_STREAM, block_start_ms, block, block_length);
+		block_sequence++;
+	}
+	block_scan_count = 0;
+ }
+
+ static void add_scan(adc_scan_t * scan)
+ {
+	uint8_t i;
+
+	if(block_length + ADC_STREAM_MAX_SCAN_SIZE > USB_FRAME_MAX_PAYLOAD_SIZE)
+	{
+		send_block();
+	}
+
+	if(block_scan_count == 0)
+	{
+		uint16_t overruns = ring_overrun_count;
+		uint16_t missed = missed_scan_count;
+		memcpy(&block[0], &block_sequence, 2);
+		memcpy(&block[2], &overruns, 2);
+		memcpy(&block[4], &missed, 2);
+		memcpy(&block[ADC_STREAM_BLOCK_HEADER_SIZE], scan->channel, sizeof(scan->channel));
+		block_length = ADC_STREAM_BLOCK_HEADER_SIZE + sizeof(scan->channel);
+		block_start_ms = scan->time_ms;
+	}
+	else
+	{
+		for(i = 0; i < ADC_NUM_CHANNELS; i++)
+		{
+			block_length += encode_varint((int32_t) scan->channel[i] - (int32_t) last_scan[i], &block[block_length]);
+		}
+	}
+
+	memcpy(last_scan, scan->channel, sizeof(last_scan));
+	block_scan_count++;
+ }
+
+ /*
+ *	\brief Encodes queued scans and sends blocks once full or stale, call periodically
+ */
+ void adc_stream_process(void)
+ {
+	uint32_t current_time_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+	while(ring_tail != ring_head)
+	{
+		add_scan(&scan_ring[ring_tail % ADC_STREAM_RING_SCANS]);
+		ring_tail++;
+	}
+
+	if(block_scan_count > 0 &&
+		(!stream_enabled || (current_time_ms - block_start_ms) >= ADC_STREAM_BLOCK_MAX_AGE_MS))
+	{
+		send_block();
+	}
+ }
\ No newline at end of file
@@ -0,0 +1,45 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file adc_stream.h
+ *
+ * \brief Compressed raw ADC scan streaming for diagnostics
+ *
+ */
+
+
+#ifndef ADC_STREAM_H_
+#define ADC_STREAM_H_
+
+#define ADC_STREAM_RING_SCANS			(32)	// Power of two
+#define ADC_STREAM_BLOCK_HEADER_SIZE	(7)		// sequence, ring overruns, missed triggers, scan count
+#define ADC_STREAM_MAX_SCAN_SIZE		(2 * ADC_NUM_CHANNELS)	// Zig-zag of a 12 bit delta is at most two varint bytes
+#define ADC_STREAM_BLOCK_MAX_AGE_MS		(50)
+
+void adc_stream_enable(bool enable);
+bool adc_stream_is_enabled(void);
+void adc_stream_push(volatile uint16_t * scan);
+void adc_stream_count_missed_scan(void);
+void adc_stream_process(void);
+
+#endif /* ADC_STREAM_H_ */
\ No newline at end of file
@@ -29,10 +29,20 @@ SOFTWARE.*/
 
 #include "task_monitor.h"
 
+#include "telemetry.h"
+
 #include "alarm_monitoring.h"
 
 static volatile uint32_t alarm_bitfield = 0;
 
+/*
+*	\brief Sets up alarm monitoring
+*/
+void alarm_monitoring_init(void)
+{
+	telemetry_register(TELEMETRY_ALARMS, TELEMETRY_U32, &alarm_bitfield);
+}
+
 /*
 *	\brief Sets an alarm status
 *
@@ -41,9 +41,11 @@ typedef enum
 	ALARM_MOTOR_ERROR = 3,
 	ALARM_MOTOR_TEMP = 4,
 	ALARM_SETTINGS_LOAD = 5,
-	ALARM_P_RAMP_SETTINGS_INVALID=6
+	ALARM_P_RAMP_SETTINGS_INVALID=6,
+	ALARM_OVERPRESSURE = 7	// Latched by the ADC window monitor until the system is disabled
 } ALARM_TYPE_INDEX;
 
+void alarm_monitoring_init(void);
 void set_alarm(ALARM_TYPE_INDEX alarm_type, bool set);
 bool check_alarm(ALARM_TYPE_INDEX alarm_type);
 uint32_t get_alarm_bitfield(void);
@@ -27,13 +27,80 @@ SOFTWARE.*/
  *
  */
 
+ #include <math.h>
+
  #include "../task_monitor.h"
  #include "../task_control.h"
 
  #include "alarm_monitoring.h"
+ #include "empc.h"
+ #include "feedforward.h"
+ #include "ilc.h"
+ #include "motor_interface.h"
+ #include "motor_speed.h"
+ #include "smith_predictor.h"
 
  #include "controller.h"
- 
+
+ // Set point rate at the middle of a transition, relative to a straight ramp, and the jerk
+ // that reaches it, for a transition of unit length and height
+ #define RAMP_PEAK_RATE		(1.0 / (1.0 - CONTROLLER_RAMP_ACCEL_FRACTION))
+ #define RAMP_JERK			(4.0 * RAMP_PEAK_RATE / (CONTROLLER_RAMP_ACCEL_FRACTION * CONTROLLER_RAMP_ACCEL_FRACTION))
+
+ // PIDF state, the integral is kept in output units so ki can change or be zero
+ static float integral_term = 0.0;
+ static float error_derivative = 0.0;
+ static float last_error = 0.0;
+ static float unsaturated_output = 0.0;	// Last cycle's output before any clamp
+ static float unsaturated_filtered = 0.0;	// The same through a replica of the drive_motor slew filter
+ static float applied_output = 0.0;		// Last cycle's command as the motor received it
+
+ /*
+ *	\brief Gets how far through a transition the set point is, jerk limited
+ *
+ *	Acceleration is a triangle over the first and last CONTROLLER_RAMP_ACCEL_FRACTION, with
+ *	constant rate between, so the set point and its first two derivatives are continuous.
+ *	Starts and ends at the same times as a straight ramp.
+ *
+ *	\param portion Time into the transition over its length
+ *
+ *	\return Portion of the way from the start to the end pressure, 0 to 1
+ */
+ static float ramp_shape(float portion)
+ {
+	if(portion <= 0.0)
+	{
+		return 0.0;
+	}
+	if(portion >= 1.0)
+	{
+		return 1.0;
+	}
+
+	// The second half mirrors the first
+	bool mirrored = (portion > 0.5);
+	float t = mirrored ? (1.0 - portion) : portion;
+	float shape;
+
+	if(t < 0.5 * CONTROLLER_RAMP_ACCEL_FRACTION)
+	{
+		// Jerk up
+		shape = RAMP_JERK * t * t * t / 6.0;
+	}
+	else if(t < CONTROLLER_RAMP_ACCEL_FRACTION)
+	{
+		// Jerk down to the peak rate
+		float u = CONTROLLER_RAMP_ACCEL_FRACTION - t;
+		shape = RAMP_PEAK_RATE * (0.5 * CONTROLLER_RAMP_ACCEL_FRACTION - u) + RAMP_JERK * u * u * u / 6.0;
+	}
+	else
+	{
+		shape = RAMP_PEAK_RATE * (t - 0.5 * CONTROLLER_RAMP_ACCEL_FRACTION);
+	}
+
+	return mirrored ? (1.0 - shape) : shape;
+ }
+
  static uint32_t calculate_new_setpoint(uint32_t stage_start_time_ms, uint32_t current_time_ms, lcv_state_t * state, lcv_control_t * control)
  {
 	int32_t time_into_profile = current_time_ms - stage_start_time_ms;
@@ -41,30 +108,35 @@ SOFTWARE.*/
 	// In PEEP to PIP stage?
 	if(time_into_profile < control->peep_to_pip_rampup_ms)
 	{
-		// Linear ramp up
+		// Jerk limited ramp up
+		control->profile_stage = PROFILE_STAGE_RISE;
 		control->pressure_set_point_cm_h20 = state->setting_state.peep_cm_h20;
-		float section_factor = ((float) (time_into_profile) / (float) control->peep_to_pip_rampup_ms);
-		control->pressure_set_point_cm_h20 += (int32_t)  (section_factor * (state->setting_state.pip_cm_h20 - state->setting_state.peep_cm_h20));
+		float section_factor = ramp_shape(time_into_profile * control->rampup_inverse_ms);
+		control->pressure_set_point_cm_h20 += section_factor * (state->setting_state.pip_cm_h20 - state->setting_state.peep_cm_h20);
 	}
 	else if(time_into_profile < (control->peep_to_pip_rampup_ms + control->pip_hold_ms))
 	{
+		control->profile_stage = PROFILE_STAGE_PIP_HOLD;
 		control->pressure_set_point_cm_h20 = state->setting_state.pip_cm_h20;
 	}
 	else if(time_into_profile < (control->peep_to_pip_rampup_ms + control->pip_hold_ms + control->pip_to_peep_rampdown_ms))
 	{
-		// Linear ramp down
+		// Jerk limited ramp down
+		control->profile_stage = PROFILE_STAGE_FALL;
 		control->pressure_set_point_cm_h20 = state->setting_state.pip_cm_h20;
 		
 		float section_dt = time_into_profile - (control->peep_to_pip_rampup_ms + control->pip_hold_ms);
-		control->pressure_set_point_cm_h20 += (section_dt / (float) control->pip_to_peep_rampdown_ms) * (state->setting_state.peep_cm_h20 - state->setting_state.pip_cm_h20);
+		control->pressure_set_point_cm_h20 += ramp_shape(section_dt * control->rampdown_inverse_ms) * (state->setting_state.peep_cm_h20 - state->setting_state.pip_cm_h20);
 	}
 	else if(time_into_profile < (control->peep_to_pip_rampup_ms + control->pip_hold_ms + control->pip_to_peep_rampdown_ms + control->peep_hold_ms))
 	{
+		control->profile_stage = PROFILE_STAGE_PEEP_HOLD;
 		control->pressure_set_point_cm_h20 = state->setting_state.peep_cm_h20;
 	}
 	else
 	{
 		// Time over this setpoint, return new transition time, keep at PEEP
+		control->profile_stage = PROFILE_STAGE_PEEP_HOLD;
 		control->pressure_set_point_cm_h20 = state->setting_state.peep_cm_h20;
 		new_state_start = stage_start_time_ms + (control->peep_to_pip_rampup_ms + control->pip_hold_ms + control->pip_to_peep_rampdown_ms + control->peep_hold_ms);
 	}
@@ -74,41 +146,64 @@ SOFTWARE.*/
  /*
  *	\brief Performs PIDF control
  *
- *	Has integral error range and anti-windup
+ *	Has integral error range and back-calculation anti-windup: whatever the clamps and thermal
+ *	limit took off the output, as seen after the drive_motor slew filter, bleeds out of the
+ *	integral over CONTROLLER_ANTIWINDUP_TRACKING_S. The filter's own lag is not windup, so
+ *	the applied command is compared with the unclamped output through a replica filter.
+ *	With ki at 0 there is no integral state and no tracking.
  *	Has derivative filtering
+ *	Feedforward comes from the learned map, seeded from kf
  *	Note: this is a tracking controller, so "derivative" can somewhat abruptly change, need to be careful
  *
  *	\param control Pointer to the control structure defining the pressure profile
  *	\param params Pointer to the structure holding controller tuning parameters
+ *	\param pressure_cm_h2o The pressure to act on, measured or predicted
  */
- static float pidf_control(lcv_control_t * control, controller_param_t * params)
+ static float pidf_control(lcv_control_t * control, controller_param_t * params, float pressure_cm_h2o)
  {
-	static float error_integral = 0.0;
-	static float error_derivative = 0.0;
-	static float last_error = 0.0;
-
-	float error = control->pressure_set_point_cm_h20 - control->pressure_current_cm_h20;
+	float error = control->pressure_set_point_cm_h20 - pressure_cm_h2o;
 
 	float alpha = 0.7;
 	error_derivative = alpha*(error-last_error) + (1.0 - alpha)*error_derivative;
 
-	if(abs(error) < params->integral_enable_error_range)
+	// The inner speed loop drives the DAC without the slew filter
+	float filter_alpha = 0.0;
+	if(!MOTOR_SPEED_LOOP_ENABLE)
+	{
+		filter_alpha = (unsaturated_output >= unsaturated_filtered) ? MOTOR_COMMAND_ALPHA_UP : MOTOR_COMMAND_ALPHA_DOWN;
+	}
+	unsaturated_filtered = filter_alpha * unsaturated_filtered + (1.0 - filter_alpha) * unsaturated_output;
+
+	if(params->ki > 0.0)
 	{
-		error_integral += error;
-		if(abs(error_integral * params->ki) > params->integral_antiwindup)
+		// Far from the set point the integral holds rather than resetting, tracking still runs
+		if(fabsf(error) < params->integral_enable_error_range)
 		{
-			error_integral	= (error_integral/abs(error_integral)) * (params->integral_antiwindup) / params->ki;
+			integral_term += params->ki * error;
 		}
+		integral_term += (CONTROLLER_PERIOD_S / CONTROLLER_ANTIWINDUP_TRACKING_S) * (applied_output - unsaturated_filtered);
 	}
 	else
 	{
-		error_integral = 0.0;
+		// ki of 0 means no integral state, tracking alone would only ever wind it down
+		integral_term = 0.0;
 	}
 
-	float output = params->kf * control->pressure_set_point_cm_h20 +
+	// Hard limit as a backstop
+	if(integral_term > params->integral_antiwindup)
+	{
+		integral_term = params->integral_antiwindup;
+	}
+	if(integral_term < -params->integral_antiwindup)
+	{
+		integral_term = -params->integral_antiwindup;
+	}
+
+	float output = feedforward_get(control->pressure_set_point_cm_h20) +
 					params->kp * error +
-					params->ki * error_integral +
+					integral_term +
 					params->kd * error_derivative;
+	unsaturated_output = output;
 
 	if(output > params->max_output)
 	{
@@ -124,6 +219,61 @@ SOFTWARE.*/
 	return output;
  }
 
+ /*
+ *	\brief Clears the PIDF state, for when the motor stops
+ */
+ static void pidf_reset(void)
+ {
+	integral_term = 0.0;
+	error_derivative = 0.0;
+	last_error = 0.0;
+	unsaturated_output = 0.0;
+	unsaturated_filtered = 0.0;
+	applied_output = 0.0;
+ }
+
+ /*
+ *	\brief Teaches the feedforward map what a held set point really needs
+ *
+ *	\param state Pointer to the state structure holding current and set parameters
+ *	\param control Pointer to the control structure defining the pressure profile
+ *	\param params Pointer to the structure holding controller tuning parameters
+ *	\param output The controller output this cycle
+ */
+ static void learn_feedforward(lcv_state_t * state, lcv_control_t * control, controller_param_t * params, float output)
+ {
+	static PROFILE_STAGE last_stage = PROFILE_STAGE_RISE;
+	static int32_t last_level_cm_h2o = -1;
+	static uint32_t settled_cycles = 0;
+
+	// Only the holds sit at one set point, which is the setting itself
+	bool held = (control->profile_stage == PROFILE_STAGE_PIP_HOLD || control->profile_stage == PROFILE_STAGE_PEEP_HOLD);
+	int32_t level_cm_h2o = (control->profile_stage == PROFILE_STAGE_PIP_HOLD) ? state->setting_state.pip_cm_h20 : state->setting_state.peep_cm_h20;
+
+	if(!held || control->profile_stage != last_stage || level_cm_h2o != last_level_cm_h2o || !state->current_state.enable)
+	{
+		last_stage = control->profile_stage;
+		last_level_cm_h2o = level_cm_h2o;
+		settled_cycles = 0;
+		return;
+	}
+
+	// PEEP and PIP holds, once the rise or fall has died out
+	if(settled_cycles < FEEDFORWARD_SETTLE_CYCLES)
+	{
+		settled_cycles++;
+		return;
+	}
+
+	// A clamped output says nothing about what the set point needs
+	if(output >= params->max_output || output <= params->min_output)
+	{
+		return;
+	}
+
+	feedforward_learn(control->pressure_set_point_cm_h20, output - feedforward_get(control->pressure_set_point_cm_h20));
+ }
+
  /*
  *	\brief Calculates the control profile given the input settings
  *
@@ -132,13 +282,21 @@ SOFTWARE.*/
  */
  void calculate_lcv_control_params(lcv_state_t * state, lcv_control_t * control)
  {
-	// Pressure control profile is piecewise linear
+	// The breath corrections were learned on the old profile
+	ilc_request_reset();
+
+	// Pressure control profile, transitions are jerk limited S curves of the set rise and fall times
 	/*
 	*	PIP	         ________
 	*			   /		  \
 	*			 /			    \
 	*	PEEP   /				  \____________
 	*/
+	control->peep_to_pip_rampup_ms = state->setting_state.rise_time_ms;
+	control->pip_to_peep_rampdown_ms = state->setting_state.fall_time_ms;
+	control->rampup_inverse_ms = 1.0 / control->peep_to_pip_rampup_ms;
+	control->rampdown_inverse_ms = 1.0 / control->pip_to_peep_rampdown_ms;
+
 	float breath_cycle_total_time_ms = (60000.0) / state->setting_state.breath_per_min;
 	float breath_cycle_total_time_ms_minus_ramps = breath_cycle_total_time_ms - (control->pip_to_peep_rampdown_ms + control->peep_to_pip_rampup_ms);
 
@@ -196,10 +354,87 @@ SOFTWARE.*/
 
 	// First, determine what the new setpoint should be
 	// Updates profile if enters a new profile
+	uint32_t previous_profile_start_ms = start_of_current_profile_time_ms;
 	start_of_current_profile_time_ms = calculate_new_setpoint(start_of_current_profile_time_ms, current_time_ms, state, control);
 
+	float cycle_ms = control->peep_to_pip_rampup_ms + control->pip_hold_ms + control->pip_to_peep_rampdown_ms + control->peep_hold_ms;
+	if(start_of_current_profile_time_ms != previous_profile_start_ms && was_enabled)
+	{
+		ilc_end_of_breath(cycle_ms);
+	}
+
 	// Then, run the controller to track this setpoint
-	float output = pidf_control(control, params);
+	float pressure_cm_h2o = control->pressure_current_cm_h20;
+	if(CONTROLLER_SMITH_PREDICTOR_ENABLE)
+	{
+		// Act on where the pressure is heading rather than the lagged reading
+		pressure_cm_h2o = smith_predict(pressure_cm_h2o);
+	}
+	float output;
+	if(CONTROLLER_BACKEND == CONTROLLER_BACKEND_EMPC)
+	{
+		output = empc_control(control->pressure_set_point_cm_h20, pressure_cm_h2o);
+		if(output > params->max_output)
+		{
+			output = params->max_output;
+		}
+		if(output < params->min_output)
+		{
+			output = params->min_output;
+		}
+	}
+	else
+	{
+		output = pidf_control(control, params, pressure_cm_h2o);
+	}
+	learn_feedforward(state, control, params, output);
+
+	// Finally, add what earlier breaths learned about this point in the profile
+	if(state->current_state.enable && cycle_ms > 0.0)
+	{
+		float phase = (current_time_ms - start_of_current_profile_time_ms) / cycle_ms;
+		float correction = ilc_step(phase, control->pressure_set_point_cm_h20 - control->pressure_current_cm_h20);
+		output += correction;
+		unsaturated_output += correction;	// Not a saturation for the anti-windup
+
+		if(output > params->max_output)
+		{
+			output = params->max_output;
+		}
+		if(output < params->min_output)
+		{
+			output = params->min_output;
+		}
+	}
+	else
+	{
+		ilc_request_reset();
+	}
+
+	if(state->current_state.enable)
+	{
+		smith_update(output);
+		empc_update(output);
+	}
+	else
+	{
+		smith_reset();
+		empc_reset();
+		pidf_reset();
+	}
+
 	was_enabled = (state->current_state.enable > 0);
 	return output;
+ }
+
+ /*
+ *	\brief Tells the controller what the motor actually received for its last output
+ *
+ *	Feeds the back-calculation anti-windup in pidf_control
+ *
+ *	\param command The command after drive_motor's slew filter, or the inner loop's set point
+ */
+ void controller_set_applied_output(float command)
+ {
+	applied_output = command;
  }
\ No newline at end of file
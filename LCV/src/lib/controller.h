@@ -33,11 +33,22 @@ SOFTWARE.*/
 
 #include "../task_control.h"
 
+#define CONTROLLER_SMITH_PREDICTOR_ENABLE	(0)	// PIDF acts on the dead time compensated pressure, retune gains up when set
+
+#define CONTROLLER_PERIOD_S					(0.01)
+#define CONTROLLER_ANTIWINDUP_TRACKING_S	(0.05)	// Time for the integral to bleed off output the motor did not get
+
+#define CONTROLLER_RAMP_ACCEL_FRACTION		(0.25)	// Share of each rise and fall spent speeding up, and again slowing down
+
+#define CONTROLLER_BACKEND_PIDF				(0)
+#define CONTROLLER_BACKEND_EMPC				(1)	// Regions from Interface/empc_gen.py, regenerate for a new blower
+#define CONTROLLER_BACKEND					(CONTROLLER_BACKEND_PIDF)
+
 typedef struct
 {
-	float kf;
+	float kf;	// Seeds the feedforward map, which is then learned
 	float kp;
-	float ki;
+	float ki;	// 0 for no integral state, see pidf_control
 	float kd;
 	float integral_antiwindup;
 	float integral_enable_error_range;
@@ -47,5 +58,6 @@ typedef struct
 
 void calculate_lcv_control_params(lcv_state_t * state, lcv_control_t * control);
 float run_controller(lcv_state_t * state, lcv_control_t * control, controller_param_t * params);
+void controller_set_applied_output(float command);
 
 #endif /* CONTROLLER_H_ */
\ No newline at end of file
@@ -0,0 +1,111 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file empc.c
+ *
+ * \brief Explicit model predictive pressure control
+ *
+ */
+
+ #include <math.h>
+
+ #include "../task_monitor.h"
+
+ #include "feedforward.h"
+ #include "motor_interface.h"
+ #include "motor_speed.h"
+
+ #include "empc.h"
+ #include "empc_table.h"
+
+ // The law is solved offline around the command that holds the set point, so it needs the
+ // slew filtered command the blower sees as well as the pressure
+ static float command_model = 0.0;
+
+ /*
+ *	\brief Finds the cell a value falls in along one grid axis, saturating at the edges
+ */
+ static uint8_t empc_cell(float value, float min, float step, uint8_t cells)
+ {
+	float position = floorf((value - min) / step);
+	int32_t cell = (int32_t) position;
+	if(cell < 0)
+	{
+		return 0;
+	}
+	if(cell >= cells)
+	{
+		return cells - 1;
+	}
+	return (uint8_t) cell;
+ }
+
+ /*
+ *	\brief Empties the command model, for when the motor stops
+ */
+ void empc_reset(void)
+ {
+	command_model = 0.0;
+ }
+
+ /*
+ *	\brief Gets the first move of the constrained optimal command sequence
+ *
+ *	Locates the pressure error, filtered command error and steady state command in the grid
+ *	from Interface/empc_gen.py, then evaluates that region's affine law. No optimisation runs
+ *	here, so the cost is a few multiplies and a table lookup.
+ *
+ *	\param set_point_cm_h2o The pressure set point
+ *	\param pressure_cm_h2o The pressure to act on, measured or predicted
+ *
+ *	\return The motor command, caller clamps it to the output limits
+ */
+ float empc_control(float set_point_cm_h2o, float pressure_cm_h2o)
+ {
+	float steady_command = feedforward_get(set_point_cm_h2o);
+	float pressure_error = pressure_cm_h2o - set_point_cm_h2o;
+	float command_error = command_model - steady_command;
+
+	uint8_t i = empc_cell(pressure_error, EMPC_DP_MIN, EMPC_DP_STEP, EMPC_DP_CELLS);
+	uint8_t j = empc_cell(command_error, EMPC_DU_MIN, EMPC_DU_STEP, EMPC_DU_CELLS);
+	uint8_t k = empc_cell(steady_command, EMPC_USS_MIN, EMPC_USS_STEP, EMPC_USS_CELLS);
+	const float * law = empc_regions[empc_cells[k][j][i]];
+
+	return steady_command + law[0] * pressure_error + law[1] * command_error + law[2] * steady_command + law[3];
+ }
+
+ /*
+ *	\brief Runs the command model one control cycle on the command just output
+ *
+ *	\param command The motor command, 0 to 1
+ */
+ void empc_update(float command)
+ {
+	// The inner speed loop drives the DAC without the slew filter
+	float alpha = 0.0;
+	if(!MOTOR_SPEED_LOOP_ENABLE)
+	{
+		alpha = (command >= command_model) ? MOTOR_COMMAND_ALPHA_UP : MOTOR_COMMAND_ALPHA_DOWN;
+	}
+	command_model = alpha * command_model + (1.0 - alpha) * command;
+ }
\ No newline at end of file
@@ -0,0 +1,254 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file feedforward.c
+ *
+ * \brief Learned blower feedforward map
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "checksum.h"
+ #include "fm25l16b.h"
+
+ #include "feedforward.h"
+
+ #define FEEDFORWARD_STORAGE_SCALE		(10000.0)	// Stored as ten thousandths of full command
+
+ static float feedforward_map[FEEDFORWARD_NUM_POINTS];
+ static bool map_changed = false;
+ static TickType_t last_save_tick = 0;
+
+ static void feedforward_load_cb(uint8_t * buff, uint32_t length)
+ {
+	// WARNING: ISR context
+	if(length != FRAM_READ_HEADER_SIZE + FEEDFORWARD_STORAGE_SIZE)
+	{
+		return;
+	}
+
+	uint8_t * data = buff + FRAM_READ_HEADER_SIZE;
+	if(data[0] != FEEDFORWARD_STORAGE_VERSION ||
+		crc_8(data, FEEDFORWARD_STORAGE_SIZE - 1) != data[FEEDFORWARD_STORAGE_SIZE - 1])
+	{
+		// Blank or corrupt, keep the seed
+		return;
+	}
+
+	uint8_t i;
+	for(i = 0; i < FEEDFORWARD_NUM_POINTS; i++)
+	{
+		uint16_t value;
+		memcpy(&value, &data[1 + 2 * i], 2);
+		feedforward_map[i] = value / FEEDFORWARD_STORAGE_SCALE;
+	}
+ }
+
+ /*
+ *	\brief Keeps the map rising with pressure, outward from the points just moved
+ *
+ *	\param index The lower of the two points just moved
+ */
+ static void keep_monotonic(uint8_t index)
+ {
+	int32_t i;
+	for(i = index + 1; i < FEEDFORWARD_NUM_POINTS; i++)
+	{
+		if(feedforward_map[i] < feedforward_map[i - 1])
+		{
+			feedforward_map[i] = feedforward_map[i - 1];
+		}
+	}
+	for(i = index - 1; i >= 0; i--)
+	{
+		if(feedforward_map[i] > feedforward_map[i + 1])
+		{
+			feedforward_map[i] = feedforward_map[i + 1];
+		}
+	}
+ }
+
+ /*
+ *	\brief Starts the map as the straight line kf * pressure, used until a learned map is loaded
+ *
+ *	\param kf Motor command per cm-H2O
+ */
+ void feedforward_seed(float kf)
+ {
+	uint8_t i;
+	for(i = 0; i < FEEDFORWARD_NUM_POINTS; i++)
+	{
+		float value = kf * i * FEEDFORWARD_POINT_SPACING_CM_H2O;
+		feedforward_map[i] = (value > 1.0) ? 1.0 : ((value < 0.0) ? 0.0 : value);
+	}
+	map_changed = true;
+ }
+
+ /*
+ *	\brief Gets the feedforward motor command, linear between map points
+ *
+ *	\param pressure_cm_h2o The pressure set point
+ *
+ *	\return The motor command, 0 to 1
+ */
+ float feedforward_get(float pressure_cm_h2o)
+ {
+	float position = pressure_cm_h2o / FEEDFORWARD_POINT_SPACING_CM_H2O;
+	if(position <= 0.0)
+	{
+		return feedforward_map[0];
+	}
+	if(position >= FEEDFORWARD_NUM_POINTS - 1)
+	{
+		return feedforward_map[FEEDFORWARD_NUM_POINTS - 1];
+	}
+
+	uint8_t index = (uint8_t) position;
+	float fraction = position - index;
+	return feedforward_map[index] + fraction * (feedforward_map[index + 1] - feedforward_map[index]);
+ }
+
+ /*
+ *	\brief Gets the pressure the map says a motor command holds, the inverse of feedforward_get
+ *
+ *	\param command The motor command, 0 to 1
+ *
+ *	\return The pressure in cm-H2O
+ */
+ float feedforward_get_pressure(float command)
+ {
+	uint8_t i;
+
+	if(command <= feedforward_map[0])
+	{
+		return 0.0;
+	}
+	for(i = 0; i < FEEDFORWARD_NUM_POINTS - 1; i++)
+	{
+		// The map only rises, so flat parts are skipped
+		if(command < feedforward_map[i + 1])
+		{
+			float fraction = (command - feedforward_map[i]) / (feedforward_map[i + 1] - feedforward_map[i]);
+			return (i + fraction) * FEEDFORWARD_POINT_SPACING_CM_H2O;
+		}
+	}
+	return (FEEDFORWARD_NUM_POINTS - 1) * FEEDFORWARD_POINT_SPACING_CM_H2O;
+ }
+
+ /*
+ *	\brief Moves part of the feedback effort at a settled set point into the map
+ *
+ *	The two points either side take it in proportion to their interpolation weights, so the
+ *	map converges to the command each pressure really needs and the feedback terms go to zero.
+ *	Call only when the pressure has settled at a constant set point and the output is not clamped.
+ *
+ *	\param pressure_cm_h2o The settled set point
+ *	\param feedback The controller output less the feedforward
+ */
+ void feedforward_learn(float pressure_cm_h2o, float feedback)
+ {
+	float position = pressure_cm_h2o / FEEDFORWARD_POINT_SPACING_CM_H2O;
+	if(position < 0.0 || position >= FEEDFORWARD_NUM_POINTS - 1)
+	{
+		return;
+	}
+
+	uint8_t index = (uint8_t) position;
+	float fraction = position - index;
+	float step = FEEDFORWARD_LEARNING_RATE * feedback;
+
+	feedforward_map[index] += (1.0 - fraction) * step;
+	feedforward_map[index + 1] += fraction * step;
+
+	uint8_t i;
+	for(i = index; i <= index + 1; i++)
+	{
+		if(feedforward_map[i] > 1.0)
+		{
+			feedforward_map[i] = 1.0;
+		}
+		if(feedforward_map[i] < 0.0)
+		{
+			feedforward_map[i] = 0.0;
+		}
+	}
+	keep_monotonic(index);
+
+	map_changed = true;
+ }
+
+ /*
+ *	\brief Starts reading the learned map from FRAM, replaces the seed if valid
+ *
+ *	\return True if the read was started
+ */
+ bool feedforward_load_asynch(void)
+ {
+	bool started = fram_read_asynch(FRAM_FEEDFORWARD_ADDRESS, FEEDFORWARD_STORAGE_SIZE, feedforward_load_cb);
+	if(started)
+	{
+		// A seed before the load has nothing worth saving
+		map_changed = false;
+		last_save_tick = xTaskGetTickCount();
+	}
+	return started;
+ }
+
+ /*
+ *	\brief Checks if the map has been learned since the last save and the save interval is up
+ *
+ *	\return True if it should be saved
+ */
+ bool feedforward_save_due(void)
+ {
+	return map_changed && (xTaskGetTickCount() - last_save_tick) >= pdMS_TO_TICKS(FEEDFORWARD_SAVE_INTERVAL_MS);
+ }
+
+ /*
+ *	\brief Starts writing the map to FRAM
+ *
+ *	\return True if the write was started, otherwise try again later
+ */
+ bool feedforward_save_asynch(void)
+ {
+	uint8_t data[FEEDFORWARD_STORAGE_SIZE];
+	uint8_t i;
+
+	data[0] = FEEDFORWARD_STORAGE_VERSION;
+	for(i = 0; i < FEEDFORWARD_NUM_POINTS; i++)
+	{
+		uint16_t value = (uint16_t) (feedforward_map[i] * FEEDFORWARD_STORAGE_SCALE + 0.5);
+		memcpy(&data[1 + 2 * i], &value, 2);
+	}
+	data[FEEDFORWARD_STORAGE_SIZE - 1] = crc_8(data, FEEDFORWARD_STORAGE_SIZE - 1);
+
+	if(!fram_write_asynch(FRAM_FEEDFORWARD_ADDRESS, data, FEEDFORWARD_STORAGE_SIZE))
+	{
+		return false;
+	}
+
+	map_changed = false;
+	last_save_tick = xTaskGetTickCount();
+	return true;
+ }
\ No newline at end of file
@@ -0,0 +1,50 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file feedforward.h
+ *
+ * \brief Learned blower feedforward map
+ *
+ */
+
+
+#ifndef FEEDFORWARD_H_
+#define FEEDFORWARD_H_
+
+#define FEEDFORWARD_NUM_POINTS				(13)	// Every FEEDFORWARD_POINT_SPACING up to 60 cm-H2O
+#define FEEDFORWARD_POINT_SPACING_CM_H2O	(5.0)
+#define FEEDFORWARD_SETTLE_CYCLES			(30)	// Controller cycles a set point must hold before learning
+#define FEEDFORWARD_LEARNING_RATE			(0.01)	// Portion of the feedback effort moved into the map per cycle
+#define FEEDFORWARD_SAVE_INTERVAL_MS		(60000)
+#define FEEDFORWARD_STORAGE_VERSION			(1)
+#define FEEDFORWARD_STORAGE_SIZE			(1 + 2 * FEEDFORWARD_NUM_POINTS + 1)	// Version, points, crc8
+
+void feedforward_seed(float kf);
+float feedforward_get(float pressure_cm_h2o);
+float feedforward_get_pressure(float command);
+void feedforward_learn(float pressure_cm_h2o, float feedback);
+bool feedforward_load_asynch(void);
+bool feedforward_save_due(void);
+bool feedforward_save_asynch(void);
+
+#endif /* FEEDFORWARD_H_ */
\ No newline at end of file
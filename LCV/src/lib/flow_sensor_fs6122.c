@@ -29,6 +29,8 @@ SOFTWARE.*/
 
  #include "../task_monitor.h"
 
+ #include "telemetry.h"
+
  #include "flow_sensor_fs6122.h"
  #include <string.h>
 
@@ -71,6 +73,8 @@ SOFTWARE.*/
 	i2c_master_register_callback(&i2c_master_instance, flow_sensor_slm_callback, I2C_MASTER_CALLBACK_READ_COMPLETE);
 	i2c_master_enable_callback(&i2c_master_instance, I2C_MASTER_CALLBACK_READ_COMPLETE);
 
+	telemetry_register(TELEMETRY_FLOW, TELEMETRY_I32, &current_data.flow_thousand_slpm);
+
 	// request read for next cycle
 	static uint8_t flow_request_to_send = 0x84;
 	// First have to request read, delay 2ms, and then read
@@ -28,6 +28,7 @@ SOFTWARE.*/
  */
 
  #include "../task_monitor.h"
+ #include "../task_hmi.h"
 
  #include "spi_interface.h"
  #include "checksum.h"
@@ -38,8 +39,9 @@ SOFTWARE.*/
  #define STATE_STORAGE_ADDRESS				(500) // MUST not overlap
  #define ADDRESS_MASK						(0x7FF) // 11 bit addressing
 
- #define PARAMETER_STORAGE_READ_SIZE				(3+18+1)	// 3 byte header, 18 bytes of data + 1 byte crc8
- #define PARAMETER_STORAGE_WRITE_SIZE				(3+18+1)	// 3 byte header, 18 bytes of data + 1 byte crc8
+ #define PARAMETER_STORAGE_VERSION				(2)	// Bump when the layout changes. Records from before it had enable, 0 or 1, here
+ #define PARAMETER_STORAGE_READ_SIZE				(3+1+26+1)	// 3 byte header, version, 26 bytes of data + 1 byte crc8
+ #define PARAMETER_STORAGE_WRITE_SIZE				(3+1+26+1)	// 3 byte header, version, 26 bytes of data + 1 byte crc8
 
  static struct spi_slave_inst fram_slave;
 
@@ -49,18 +51,24 @@ SOFTWARE.*/
 	{
 		uint8_t crc_read = *(buff + PARAMETER_STORAGE_READ_SIZE-1);
 		uint8_t crc_calc = crc_8((buff+3), PARAMETER_STORAGE_READ_SIZE-4); // Ignore header
-		if(crc_calc == crc_read)
+		if(crc_calc == crc_read && *(buff+3) == PARAMETER_STORAGE_VERSION)
 		{
 			// Unpack
 			lcv_parameters_t params;
-			params.enable = *(buff+3);
-			params.ie_ratio_tenths = *(buff+4);
-			memcpy(&params.tidal_volume_ml, (buff+5), 4);
-			memcpy(&params.peep_cm_h20, (buff+9), 4);
-			memcpy(&params.pip_cm_h20, (buff+13), 4);
-			memcpy(&params.breath_per_min, (buff+17), 4);
-
-			update_settings(&params);
+			params.enable = *(buff+4);
+			params.ie_ratio_tenths = *(buff+5);
+			memcpy(&params.tidal_volume_ml, (buff+6), 4);
+			memcpy(&params.peep_cm_h20, (buff+10), 4);
+			memcpy(&params.pip_cm_h20, (buff+14), 4);
+			memcpy(&params.breath_per_min, (buff+18), 4);
+			memcpy(&params.rise_time_ms, (buff+22), 4);
+			memcpy(&params.fall_time_ms, (buff+26), 4);
+
+			// An 8 bit CRC lets some other data through, keep the defaults rather than use it
+			if(settings_in_range(&params))
+			{
+				update_settings(&params);
+			}
 		}
 	}
  }
@@ -70,7 +78,7 @@ SOFTWARE.*/
 	// Do nothing
  }
 
- static void write_enable(void)
+ static bool write_enable(void)
  {
 	spi_transaction_t transaction;
 	uint8_t wren = FRAM_WREN;
@@ -79,8 +87,9 @@ SOFTWARE.*/
 	transaction.cb = dummy_spi_cb;
 	transaction.slave_device = fram_slave;
 
-	spi_transact(transaction);
+	bool success = spi_transact(transaction);
 	delay_us(50); // wait TODO set up queueing
+	return success;
  }
 
  void fram_init(void)
@@ -118,7 +127,10 @@ SOFTWARE.*/
 	uint8_t tx_buff[PARAMETER_STORAGE_WRITE_SIZE];
 	spi_transaction_t transaction;
 
-	write_enable();
+	if(!write_enable())
+	{
+		return false;
+	}
 
 	// Data
 	uint16_t address = (PARAMETER_STORAGE_ADDRESS) & ADDRESS_MASK;
@@ -126,14 +138,17 @@ SOFTWARE.*/
 	tx_buff[1] = (address & 0xFF00) >> 8; // address is MSB first
 	tx_buff[2] = (address & 0x00FF);
 
-	tx_buff[3] = param->enable;
-	tx_buff[4] = param->ie_ratio_tenths;
-	memcpy(&tx_buff[5], &param->tidal_volume_ml, 4);
-	memcpy(&tx_buff[9], &param->peep_cm_h20, 4);
-	memcpy(&tx_buff[13], &param->pip_cm_h20, 4);
-	memcpy(&tx_buff[17], &param->breath_per_min, 4);
+	tx_buff[3] = PARAMETER_STORAGE_VERSION;
+	tx_buff[4] = param->enable;
+	tx_buff[5] = param->ie_ratio_tenths;
+	memcpy(&tx_buff[6], &param->tidal_volume_ml, 4);
+	memcpy(&tx_buff[10], &param->peep_cm_h20, 4);
+	memcpy(&tx_buff[14], &param->pip_cm_h20, 4);
+	memcpy(&tx_buff[18], &param->breath_per_min, 4);
+	memcpy(&tx_buff[22], &param->rise_time_ms, 4);
+	memcpy(&tx_buff[26], &param->fall_time_ms, 4);
 	// Calculate CRC8
-	tx_buff[21] = crc_8(&tx_buff[3], PARAMETER_STORAGE_WRITE_SIZE-4); // Ignore header
+	tx_buff[30] = crc_8(&tx_buff[3], PARAMETER_STORAGE_WRITE_SIZE-4); // Ignore header
 
 	transaction.tx_buff = tx_buff;
 	transaction.buffer_length = PARAMETER_STORAGE_WRITE_SIZE;
@@ -143,6 +158,76 @@ SOFTWARE.*/
 	return spi_transact(transaction);
  }
 
+ /*
+ *	\brief Reads raw bytes from FRAM
+ *
+ *	\param address The FRAM address to start reading at
+ *	\param length The number of bytes to read, up to FRAM_MAX_READ_SIZE
+ *	\param cb Callback receiving the SPI buffer, data starts after FRAM_READ_HEADER_SIZE bytes. ISR context
+ *
+ *	\return True if the read was started
+ */
+ bool fram_read_asynch(uint16_t address, uint8_t length, void (*cb)(uint8_t * buff, uint32_t length))
+ {
+	uint8_t tx_buff[FRAM_READ_HEADER_SIZE + FRAM_MAX_READ_SIZE];
+	spi_transaction_t transaction;
+
+	if(length > FRAM_MAX_READ_SIZE)
+	{
+		return false;
+	}
+
+	address &= ADDRESS_MASK;
+	tx_buff[0] = FRAM_READ;
+	tx_buff[1] = (address & 0xFF00) >> 8;  // address is MSB first
+	tx_buff[2] = (address & 0x00FF);
+
+	transaction.tx_buff = tx_buff;
+	transaction.buffer_length = FRAM_READ_HEADER_SIZE + length;
+	transaction.cb = cb;
+	transaction.slave_device = fram_slave;
+
+	return spi_transact(transaction);
+ }
+
+ /*
+ *	\brief Writes raw bytes to FRAM
+ *
+ *	\param address The FRAM address to start writing at
+ *	\param data The bytes to write, copied before returning
+ *	\param length The number of bytes to write, up to FRAM_MAX_WRITE_SIZE
+ *
+ *	\return True if the write was started
+ */
+ bool fram_write_asynch(uint16_t address, uint8_t * data, uint8_t length)
+ {
+	uint8_t tx_buff[FRAM_READ_HEADER_SIZE + FRAM_MAX_WRITE_SIZE];
+	spi_transaction_t transaction;
+
+	if(length > FRAM_MAX_WRITE_SIZE)
+	{
+		return false;
+	}
+
+	if(!write_enable())
+	{
+		return false;
+	}
+
+	address &= ADDRESS_MASK;
+	tx_buff[0] = FRAM_WRITE;
+	tx_buff[1] = (address & 0xFF00) >> 8; // address is MSB first
+	tx_buff[2] = (address & 0x00FF);
+	memcpy(&tx_buff[FRAM_READ_HEADER_SIZE], data, length);
+
+	transaction.tx_buff = tx_buff;
+	transaction.buffer_length = FRAM_READ_HEADER_SIZE + length;
+	transaction.cb = dummy_spi_cb;
+	transaction.slave_device = fram_slave;
+
+	return spi_transact(transaction);
+ }
+
  bool fram_load_states_asynch(lcv_parameters_t * state)
  {
 	return false;
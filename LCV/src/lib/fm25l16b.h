@@ -42,9 +42,19 @@ SOFTWARE.*/
 #define FRAM_READ								(0x03)
 #define FRAM_WRITE								(0x02)
 
+#define FRAM_READ_HEADER_SIZE					(3)
+#define FRAM_MAX_READ_SIZE						(48)
+#define FRAM_MAX_WRITE_SIZE						(48)
+
+// Storage map, regions MUST not overlap. Settings are at 0 and states at 500
+#define FRAM_FEEDFORWARD_ADDRESS				(600)
+#define FRAM_GAIN_SCHEDULE_ADDRESS				(700)
+
 void fram_init(void);
 bool fram_load_parameters_asynch(void);
 bool fram_save_parameters_asynch(lcv_parameters_t * param);
+bool fram_read_asynch(uint16_t address, uint8_t length, void (*cb)(uint8_t * buff, uint32_t length));
+bool fram_write_asynch(uint16_t address, uint8_t * data, uint8_t length);
 bool fram_load_states_asynch(lcv_parameters_t * state);
 bool fram_save_states_asynch(lcv_parameters_t * state);
 
@@ -0,0 +1,319 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file gain_schedule.c
+ *
+ * \brief Controller gains scheduled across the settings space
+ *
+ */
+
+ #include <math.h>
+
+ #include "../task_monitor.h"
+
+ #include "checksum.h"
+ #include "fm25l16b.h"
+
+ #include "gain_schedule.h"
+
+ #define GAIN_SCHEDULE_ALL_VALID		((1UL << GAIN_SCHEDULE_NUM_ENTRIES) - 1)
+ #define GAIN_SCHEDULE_LOAD_TRIES	(5)
+
+ static const float pip_axis[GAIN_SCHEDULE_PIP_POINTS] = {15.0, 30.0, 45.0};
+ static const float peep_axis[GAIN_SCHEDULE_PEEP_POINTS] = {5.0, 15.0};
+ static const float bpm_axis[GAIN_SCHEDULE_BPM_POINTS] = {10.0, 20.0, 30.0};
+
+ static gain_schedule_entry_t entries[GAIN_SCHEDULE_NUM_ENTRIES];
+ static volatile uint32_t valid_mask = 0;
+ static volatile uint32_t unsaved_mask = 0;
+ static volatile bool entries_changed = false;
+
+ static volatile uint8_t load_index = 0;
+ static volatile bool load_done = false;
+
+ static void pack_entry(gain_schedule_entry_t * entry, uint8_t * buff)
+ {
+	memcpy(&buff[0], &entry->kp, 4);
+	memcpy(&buff[4], &entry->ki, 4);
+	memcpy(&buff[8], &entry->kd, 4);
+ }
+
+ static bool entry_valid(gain_schedule_entry_t * entry)
+ {
+	return isfinite(entry->kp) && isfinite(entry->ki) && isfinite(entry->kd) &&
+		entry->kp >= 0.0 && entry->ki >= 0.0 && entry->kd >= 0.0;
+ }
+
+ static void entry_load_cb(uint8_t * buff, uint32_t length)
+ {
+	// WARNING: ISR context
+	uint8_t * data = buff + FRAM_READ_HEADER_SIZE;
+	gain_schedule_entry_t entry;
+
+	if(length == FRAM_READ_HEADER_SIZE + GAIN_SCHEDULE_STORAGE_SIZE &&
+		crc_8(data, GAIN_SCHEDULE_ENTRY_SIZE) == data[GAIN_SCHEDULE_ENTRY_SIZE])
+	{
+		memcpy(&entry.kp, &data[0], 4);
+		memcpy(&entry.ki, &data[4], 4);
+		memcpy(&entry.kd, &data[8], 4);
+		if(entry_valid(&entry))
+		{
+			entries[load_index] = entry;
+			valid_mask |= (1UL << load_index);
+			entries_changed = true;
+		}
+	}
+	load_done = true;
+ }
+
+ /*
+ *	\brief Finds where a value falls on an axis, held at the ends
+ *
+ *	\param axis The rising grid points
+ *	\param points The number of grid points
+ *	\param value The value to place
+ *	\param fraction Filled with the portion of the way to the next point
+ *
+ *	\return The index of the grid point at or below the value
+ */
+ static uint8_t axis_position(const float * axis, uint8_t points, float value, float * fraction)
+ {
+	uint8_t i;
+
+	*fraction = 0.0;
+	if(value <= axis[0])
+	{
+		return 0;
+	}
+	for(i = 0; i < points - 1; i++)
+	{
+		if(value < axis[i + 1])
+		{
+			*fraction = (value - axis[i]) / (axis[i + 1] - axis[i]);
+			return i;
+		}
+	}
+	return points - 1;
+ }
+
+ /*
+ *	\brief Reads every entry from FRAM, blocking a few ms. Control task start only
+ *
+ *	Entries that are blank or corrupt stay invalid, so the schedule is not used until the
+ *	host sets them
+ */
+ void gain_schedule_load(void)
+ {
+	uint8_t i;
+	for(i = 0; i < GAIN_SCHEDULE_NUM_ENTRIES; i++)
+	{
+		int32_t tries = 0;
+		load_index = i;
+		load_done = false;
+		while(!fram_read_asynch(FRAM_GAIN_SCHEDULE_ADDRESS + i * GAIN_SCHEDULE_STORAGE_SIZE,
+			GAIN_SCHEDULE_STORAGE_SIZE, entry_load_cb) && tries++ < GAIN_SCHEDULE_LOAD_TRIES)
+		{
+			vTaskDelay(pdMS_TO_TICKS(1));
+		}
+
+		tries = 0;
+		while(!load_done && tries++ < GAIN_SCHEDULE_LOAD_TRIES)
+		{
+			vTaskDelay(pdMS_TO_TICKS(1));
+		}
+	}
+ }
+
+ /*
+ *	\brief Replaces one grid entry, used from the next control cycle and saved soon after
+ *
+ *	\param index The entry index
+ *	\param entry Pointer to the new gains
+ *
+ *	\return True if the index and gains were valid
+ */
+ bool gain_schedule_set_entry(uint8_t index, gain_schedule_entry_t * entry)
+ {
+	if(index >= GAIN_SCHEDULE_NUM_ENTRIES || !entry_valid(entry))
+	{
+		return false;
+	}
+
+	taskENTER_CRITICAL();
+	entries[index] = *entry;
+	valid_mask |= (1UL << index);
+	unsaved_mask |= (1UL << index);
+	entries_changed = true;
+	taskEXIT_CRITICAL();
+	return true;
+ }
+
+ /*
+ *	\brief Gets one grid entry
+ *
+ *	\param index The entry index
+ *	\param entry Filled with the gains
+ *
+ *	\return True if the entry has been set
+ */
+ bool gain_schedule_get_entry(uint8_t index, gain_schedule_entry_t * entry)
+ {
+	if(index >= GAIN_SCHEDULE_NUM_ENTRIES)
+	{
+		return false;
+	}
+
+	taskENTER_CRITICAL();
+	*entry = entries[index];
+	bool valid = (valid_mask & (1UL << index)) != 0;
+	taskEXIT_CRITICAL();
+	return valid;
+ }
+
+ /*
+ *	\brief Checks if every entry is set, the schedule is only used when complete
+ *
+ *	\return True if complete
+ */
+ bool gain_schedule_is_complete(void)
+ {
+	return valid_mask == GAIN_SCHEDULE_ALL_VALID;
+ }
+
+ /*
+ *	\brief Checks and clears whether entries changed since the last call
+ *
+ *	\return True if the scheduled gains need to be worked out again
+ */
+ bool gain_schedule_changed(void)
+ {
+	taskENTER_CRITICAL();
+	bool changed = entries_changed;
+	entries_changed = false;
+	taskEXIT_CRITICAL();
+	return changed;
+ }
+
+ /*
+ *	\brief Interpolates the gains for the settings into the controller parameters
+ *
+ *	Trilinear between the surrounding grid points, held at the grid edges. Leaves the
+ *	parameters alone if the schedule is not complete. Call on settings or schedule changes only.
+ *
+ *	\param settings Pointer to the settings to schedule on
+ *	\param params Pointer to the parameters, kp, ki and kd are replaced
+ */
+ void gain_schedule_apply(lcv_parameters_t * settings, controller_param_t * params)
+ {
+	float fraction[3];
+	uint8_t base[3];
+	gain_schedule_entry_t sum = {0.0, 0.0, 0.0};
+	uint8_t corner;
+
+	if(!gain_schedule_is_complete())
+	{
+		return;
+	}
+
+	base[0] = axis_position(pip_axis, GAIN_SCHEDULE_PIP_POINTS, settings->pip_cm_h20, &fraction[0]);
+	base[1] = axis_position(peep_axis, GAIN_SCHEDULE_PEEP_POINTS, settings->peep_cm_h20, &fraction[1]);
+	base[2] = axis_position(bpm_axis, GAIN_SCHEDULE_BPM_POINTS, settings->breath_per_min, &fraction[2]);
+
+	taskENTER_CRITICAL();
+	for(corner = 0; corner < 8; corner++)
+	{
+		float weight = 1.0;
+		uint8_t point[3];
+		uint8_t axis;
+		for(axis = 0; axis < 3; axis++)
+		{
+			bool upper = (corner >> axis) & 1;
+			weight *= upper ? fraction[axis] : (1.0 - fraction[axis]);
+			point[axis] = base[axis] + (upper ? 1 : 0);
+		}
+		if(weight <= 0.0)
+		{
+			// Also keeps the upper corner inside the grid at the edges
+			continue;
+		}
+
+		gain_schedule_entry_t * entry = &entries[(point[2] * GAIN_SCHEDULE_PEEP_POINTS + point[1]) * GAIN_SCHEDULE_PIP_POINTS + point[0]];
+		sum.kp += weight * entry->kp;
+		sum.ki += weight * entry->ki;
+		sum.kd += weight * entry->kd;
+	}
+	taskEXIT_CRITICAL();
+
+	params->kp = sum.kp;
+	params->ki = sum.ki;
+	params->kd = sum.kd;
+ }
+
+ /*
+ *	\brief Checks if entries set by the host still need saving
+ *
+ *	\return True if a save is due
+ */
+ bool gain_schedule_save_due(void)
+ {
+	return unsaved_mask != 0;
+ }
+
+ /*
+ *	\brief Starts writing the next unsaved entry to FRAM
+ *
+ *	\return True if a write was started, otherwise try again later
+ */
+ bool gain_schedule_save_asynch(void)
+ {
+	uint8_t data[GAIN_SCHEDULE_STORAGE_SIZE];
+	uint8_t index = 0;
+
+	taskENTER_CRITICAL();
+	while(index < GAIN_SCHEDULE_NUM_ENTRIES && !(unsaved_mask & (1UL << index)))
+	{
+		index++;
+	}
+	if(index < GAIN_SCHEDULE_NUM_ENTRIES)
+	{
+		// Set again after this, the newer gains go out on a later pass
+		pack_entry(&entries[index], data);
+		unsaved_mask &= ~(1UL << index);
+	}
+	taskEXIT_CRITICAL();
+
+	if(index >= GAIN_SCHEDULE_NUM_ENTRIES)
+	{
+		return false;
+	}
+
+	data[GAIN_SCHEDULE_ENTRY_SIZE] = crc_8(data, GAIN_SCHEDULE_ENTRY_SIZE);
+	if(!fram_write_asynch(FRAM_GAIN_SCHEDULE_ADDRESS + index * GAIN_SCHEDULE_STORAGE_SIZE, data, GAIN_SCHEDULE_STORAGE_SIZE))
+	{
+		taskENTER_CRITICAL();
+		unsaved_mask |= (1UL << index);
+		taskEXIT_CRITICAL();
+		return false;
+	}
+	return true;
+ }
\ No newline at end of file
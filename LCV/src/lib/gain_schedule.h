@@ -0,0 +1,61 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file gain_schedule.h
+ *
+ * \brief Controller gains scheduled across the settings space
+ *
+ */
+
+
+#ifndef GAIN_SCHEDULE_H_
+#define GAIN_SCHEDULE_H_
+
+#include "controller.h"
+
+// Grid points, entries are indexed (bpm * PEEP points + peep) * PIP points + pip
+#define GAIN_SCHEDULE_PIP_POINTS		(3)		// 15, 30, 45 cm-H2O
+#define GAIN_SCHEDULE_PEEP_POINTS		(2)		// 5, 15 cm-H2O
+#define GAIN_SCHEDULE_BPM_POINTS		(3)		// 10, 20, 30 per minute
+#define GAIN_SCHEDULE_NUM_ENTRIES		(GAIN_SCHEDULE_PIP_POINTS * GAIN_SCHEDULE_PEEP_POINTS * GAIN_SCHEDULE_BPM_POINTS)
+
+#define GAIN_SCHEDULE_ENTRY_SIZE		(12)	// kp, ki, kd
+#define GAIN_SCHEDULE_STORAGE_SIZE		(GAIN_SCHEDULE_ENTRY_SIZE + 1)	// Each entry with its own crc8
+
+typedef struct
+{
+	float kp;
+	float ki;
+	float kd;
+} gain_schedule_entry_t;
+
+void gain_schedule_load(void);
+bool gain_schedule_set_entry(uint8_t index, gain_schedule_entry_t * entry);
+bool gain_schedule_get_entry(uint8_t index, gain_schedule_entry_t * entry);
+bool gain_schedule_is_complete(void);
+bool gain_schedule_changed(void);
+void gain_schedule_apply(lcv_parameters_t * settings, controller_param_t * params);
+bool gain_schedule_save_due(void);
+bool gain_schedule_save_asynch(void);
+
+#endif /* GAIN_SCHEDULE_H_ */
\ No newline at end of file
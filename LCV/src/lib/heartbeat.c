@@ -0,0 +1,147 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file heartbeat.c
+ *
+ * \brief Task heartbeat supervisor gating the watchdogs
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "heartbeat.h"
+
+ #define HEARTBEAT_RECORD_MAGIC		(0x48425254)
+
+ typedef struct
+ {
+	uint32_t magic;
+	uint32_t missed_mask;
+	uint32_t missed_time_ms;
+ } heartbeat_pending_t;
+
+ // Left alone by the startup code, so it survives the watchdog reset it explains
+ static heartbeat_pending_t pending_record __attribute__((section(".noinit")));
+
+ // Longest time between beats, a few periods of each task
+ static const uint16_t deadline_ms[HEARTBEAT_NUM_SOURCES] =
+ {
+	[HEARTBEAT_CONTROL] = 50,	// 10 ms loop
+	[HEARTBEAT_SENSOR] = 50,	// 10 ms tidal volume and flow tick
+	[HEARTBEAT_HMI] = 200,		// 20 ms loop
+	[HEARTBEAT_DISPLAY] = 200,	// 30 ms refresh
+	[HEARTBEAT_I2C] = 200,		// LCD transfers, one burst per refresh
+ };
+
+ static volatile TickType_t expiry_tick[HEARTBEAT_NUM_SOURCES];
+ static heartbeat_reset_record_t reset_record;
+
+ /*
+ *	\brief Picks up the record of a watchdog reset and starts every deadline
+ *
+ *	Call before the tasks are created
+ */
+ void heartbeat_init(void)
+ {
+	uint8_t i;
+
+	reset_record.reset_cause = system_get_reset_cause();
+	reset_record.missed_mask = 0;
+	reset_record.missed_time_ms = 0;
+	if((reset_record.reset_cause & SYSTEM_RESET_CAUSE_WDT) && pending_record.magic == HEARTBEAT_RECORD_MAGIC)
+	{
+		reset_record.missed_mask = pending_record.missed_mask;
+		reset_record.missed_time_ms = pending_record.missed_time_ms;
+	}
+	pending_record.magic = 0;
+
+	for(i = 0; i < HEARTBEAT_NUM_SOURCES; i++)
+	{
+		expiry_tick[i] = xTaskGetTickCount() + pdMS_TO_TICKS(HEARTBEAT_STARTUP_GRACE_MS);
+	}
+ }
+
+ /*
+ *	\brief Marks a task as alive, restarting its deadline. Task context only
+ *
+ *	\param source The task beating
+ */
+ void heartbeat_beat(HEARTBEAT_SOURCE source)
+ {
+	if(source < HEARTBEAT_NUM_SOURCES)
+	{
+		expiry_tick[source] = xTaskGetTickCount() + pdMS_TO_TICKS(deadline_ms[source]);
+	}
+ }
+
+ /*
+ *	\brief Feeds the internal and external watchdogs if every task is within its deadline
+ *
+ *	Otherwise both are starved and the late tasks are recorded for after the reset. Call
+ *	every HEARTBEAT_SUPERVISE_PERIOD_MS.
+ *
+ *	\return True if the watchdogs were fed
+ */
+ bool heartbeat_supervise(void)
+ {
+	TickType_t now = xTaskGetTickCount();
+	uint32_t missed = 0;
+	uint8_t i;
+
+	for(i = 0; i < HEARTBEAT_NUM_SOURCES; i++)
+	{
+		if((int32_t) (now - expiry_tick[i]) > 0)
+		{
+			missed |= (1 << i);
+		}
+	}
+
+	if(missed == 0)
+	{
+		wdt_reset_count();
+		ioport_set_pin_level(WATCHDOG_GPIO, !ioport_get_pin_level(WATCHDOG_GPIO));
+
+		// Recovered before the watchdog fired
+		pending_record.magic = 0;
+		return true;
+	}
+
+	if(pending_record.magic != HEARTBEAT_RECORD_MAGIC)
+	{
+		pending_record.missed_mask = 0;
+		pending_record.missed_time_ms = now * portTICK_PERIOD_MS;
+		pending_record.magic = HEARTBEAT_RECORD_MAGIC;
+	}
+	pending_record.missed_mask |= missed;
+	return false;
+ }
+
+ /*
+ *	\brief Gets the reset cause and which tasks were late if it was the watchdog
+ *
+ *	\return The record captured by heartbeat_init
+ */
+ heartbeat_reset_record_t heartbeat_get_reset_record(void)
+ {
+	return reset_record;
+ }
\ No newline at end of file
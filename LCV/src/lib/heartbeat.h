@@ -0,0 +1,65 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file heartbeat.h
+ *
+ * \brief Task heartbeat supervisor gating the watchdogs
+ *
+ */
+
+
+#ifndef HEARTBEAT_H_
+#define HEARTBEAT_H_
+
+#define HEARTBEAT_SUPERVISE_PERIOD_MS	(10)	// Also the external watchdog toggle period
+#define HEARTBEAT_STARTUP_GRACE_MS		(1000)	// Time each task gets to send its first beat
+
+/*
+*	\brief Enumeration of supervised tasks, each with a deadline in heartbeat.c
+*/
+typedef enum
+{
+	HEARTBEAT_CONTROL = 0,
+	HEARTBEAT_SENSOR = 1,
+	HEARTBEAT_HMI = 2,
+	HEARTBEAT_DISPLAY = 3,
+	HEARTBEAT_I2C = 4,
+	HEARTBEAT_NUM_SOURCES = 5
+} HEARTBEAT_SOURCE;
+
+/*
+*	\brief What the supervisor saw before the last reset
+*/
+typedef struct
+{
+	uint32_t reset_cause;		// PM RCAUSE bits
+	uint32_t missed_mask;		// Bit per HEARTBEAT_SOURCE that was late, 0 if none
+	uint32_t missed_time_ms;	// Uptime when the watchdogs stopped being fed
+} heartbeat_reset_record_t;
+
+void heartbeat_init(void);
+void heartbeat_beat(HEARTBEAT_SOURCE source);
+bool heartbeat_supervise(void);
+heartbeat_reset_record_t heartbeat_get_reset_record(void);
+
+#endif /* HEARTBEAT_H_ */
\ No newline at end of file
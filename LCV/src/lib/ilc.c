@@ -0,0 +1,134 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file ilc.c
+ *
+ * \brief Iterative learning control across breaths
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "ilc.h"
+
+ // Every breath follows the same profile, so the error at a point in one breath is mostly
+ // repeated in the next. Each breath adds its error, shifted by the blower lag, to the
+ // correction for the next.
+ static float correction[ILC_NUM_BINS];
+ static float error_sum[ILC_NUM_BINS];
+ static uint16_t error_count[ILC_NUM_BINS];
+ static volatile bool reset_pending = true;
+
+ static void clear_errors(void)
+ {
+	memset(error_sum, 0, sizeof(error_sum));
+	memset(error_count, 0, sizeof(error_count));
+ }
+
+ /*
+ *	\brief Forgets everything learned, taken up at the next step. Safe from ISR
+ *
+ *	For settings changes, which change the profile the table was learned on
+ */
+ void ilc_request_reset(void)
+ {
+	reset_pending = true;
+ }
+
+ /*
+ *	\brief Records the tracking error and gets the correction for this point in the breath
+ *
+ *	\param phase Portion of the breath cycle elapsed, 0 to 1
+ *	\param error Set point less measured pressure in cm-H2O
+ *
+ *	\return The correction to add to the motor command
+ */
+ float ilc_step(float phase, float error)
+ {
+	if(reset_pending)
+	{
+		reset_pending = false;
+		memset(correction, 0, sizeof(correction));
+		clear_errors();
+	}
+
+	int32_t bin = (int32_t) (phase * ILC_NUM_BINS);
+	if(bin < 0)
+	{
+		bin = 0;
+	}
+	if(bin >= ILC_NUM_BINS)
+	{
+		bin = ILC_NUM_BINS - 1;
+	}
+
+	error_sum[bin] += error;
+	error_count[bin]++;
+	return correction[bin];
+ }
+
+ /*
+ *	\brief Learns from the breath just finished, call when the profile starts over
+ *
+ *	\param cycle_ms Length of the breath cycle in ms
+ */
+ void ilc_end_of_breath(float cycle_ms)
+ {
+	float updated[ILC_NUM_BINS];
+	int32_t lead_bins = 0;
+	int32_t i;
+
+	if(reset_pending || cycle_ms <= 0.0)
+	{
+		clear_errors();
+		return;
+	}
+
+	lead_bins = (int32_t) (ILC_LEAD_MS * ILC_NUM_BINS / cycle_ms + 0.5);
+
+	for(i = 0; i < ILC_NUM_BINS; i++)
+	{
+		// The output in this bin shows up as pressure lead_bins later, wrapping into the next breath
+		int32_t source = (i + lead_bins) % ILC_NUM_BINS;
+		float mean_error = (error_count[source] > 0) ? (error_sum[source] / error_count[source]) : 0.0;
+		updated[i] = ILC_FORGETTING * (correction[i] + ILC_LEARNING_GAIN * mean_error);
+	}
+
+	// Smooth across neighbouring bins so noise and high frequency error are not learned
+	for(i = 0; i < ILC_NUM_BINS; i++)
+	{
+		float value = 0.25 * updated[(i + ILC_NUM_BINS - 1) % ILC_NUM_BINS] + 0.5 * updated[i] +
+			0.25 * updated[(i + 1) % ILC_NUM_BINS];
+		if(value > ILC_MAX_CORRECTION)
+		{
+			value = ILC_MAX_CORRECTION;
+		}
+		if(value < -ILC_MAX_CORRECTION)
+		{
+			value = -ILC_MAX_CORRECTION;
+		}
+		correction[i] = value;
+	}
+
+	clear_errors();
+ }
\ No newline at end of file
@@ -0,0 +1,44 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file ilc.h
+ *
+ * \brief Iterative learning control across breaths
+ *
+ */
+
+
+#ifndef ILC_H_
+#define ILC_H_
+
+#define ILC_NUM_BINS			(64)	// Across one breath cycle
+#define ILC_LEARNING_GAIN		(0.004)	// Motor command per cm-H2O of mean bin error, per breath
+#define ILC_FORGETTING			(0.99)	// Pulls the table back to zero so it tracks slow changes
+#define ILC_MAX_CORRECTION		(0.2)	// Most the table may add or take from the output
+#define ILC_LEAD_MS				(100)	// Blower to pressure lag, a bin learns from the error this much later
+
+void ilc_request_reset(void);
+float ilc_step(float phase, float error);
+void ilc_end_of_breath(float cycle_ms);
+
+#endif /* ILC_H_ */
\ No newline at end of file
@@ -0,0 +1,194 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file latency.c
+ *
+ * \brief Control loop jitter and sample to actuation latency histograms
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "timebase.h"
+
+ #include "latency.h"
+
+ typedef struct
+ {
+	int32_t bucket_start_us;
+	uint16_t bucket_width_us;
+	uint32_t count;
+	int32_t min_us;
+	int32_t max_us;
+	uint16_t buckets[LATENCY_NUM_BUCKETS];
+ } latency_histogram_t;
+
+ static volatile uint32_t event_time_us[LATENCY_NUM_EVENTS];
+ static uint32_t sample_time_us = 0;	// ADC completion seen at wake, the scan the controller uses
+ static bool wake_seen = false;
+
+ static latency_histogram_t histograms[LATENCY_NUM_HISTOGRAMS] =
+ {
+	[LATENCY_HIST_PERIOD_JITTER] = { .bucket_start_us = -400, .bucket_width_us = 50 },
+	[LATENCY_HIST_WAKE_TO_DAC] = { .bucket_start_us = 0, .bucket_width_us = 50 },
+	[LATENCY_HIST_SAMPLE_TO_DAC] = { .bucket_start_us = 0, .bucket_width_us = 250 },
+	[LATENCY_HIST_WAKE_TO_OUTPUT] = { .bucket_start_us = 0, .bucket_width_us = 50 },
+ };
+
+ static void add_sample(LATENCY_HISTOGRAM histogram, int32_t value_us)
+ {
+	latency_histogram_t * hist = &histograms[histogram];
+
+	int32_t bucket = (value_us - hist->bucket_start_us) / (int32_t) hist->bucket_width_us;
+	if(value_us < hist->bucket_start_us)
+	{
+		bucket = 0;
+	}
+	if(bucket >= LATENCY_NUM_BUCKETS)
+	{
+		bucket = LATENCY_NUM_BUCKETS - 1;
+	}
+
+	if(hist->buckets[bucket] < UINT16_MAX)
+	{
+		hist->buckets[bucket]++;
+	}
+	if(hist->count == 0 || value_us < hist->min_us)
+	{
+		hist->min_us = value_us;
+	}
+	if(hist->count == 0 || value_us > hist->max_us)
+	{
+		hist->max_us = value_us;
+	}
+	hist->count++;
+ }
+
+ static void record_event(LATENCY_EVENT event)
+ {
+	uint32_t now_us = get_time_us();
+	uint32_t last_us = event_time_us[event];
+	event_time_us[event] = now_us;
+
+	switch (event)
+	{
+		case LATENCY_CONTROL_WAKE:
+			if(wake_seen)
+			{
+				add_sample(LATENCY_HIST_PERIOD_JITTER, (int32_t) (now_us - last_us) - LATENCY_PERIOD_NOMINAL_US);
+			}
+			wake_seen = true;
+			sample_time_us = event_time_us[LATENCY_ADC_DONE];
+			break;
+
+		case LATENCY_CONTROLLER_OUTPUT:
+			if(wake_seen)
+			{
+				add_sample(LATENCY_HIST_WAKE_TO_OUTPUT, (int32_t) (now_us - event_time_us[LATENCY_CONTROL_WAKE]));
+			}
+			break;
+
+		case LATENCY_DAC_WRITE:
+			// The DAC is also written outside the control loop at start up
+			if(wake_seen)
+			{
+				add_sample(LATENCY_HIST_WAKE_TO_DAC, (int32_t) (now_us - event_time_us[LATENCY_CONTROL_WAKE]));
+				add_sample(LATENCY_HIST_SAMPLE_TO_DAC, (int32_t) (now_us - sample_time_us));
+			}
+			break;
+
+		default:
+			break;
+	}
+ }
+
+ /*
+ *	\brief Timestamps an event and updates the histograms it completes. Task context
+ *
+ *	\param event The event
+ */
+ void latency_mark(LATENCY_EVENT event)
+ {
+	taskENTER_CRITICAL();
+	record_event(event);
+	taskEXIT_CRITICAL();
+ }
+
+ /*
+ *	\brief Timestamps an event and updates the histograms it completes. ISR context
+ *
+ *	For the ADC scan and the speed loop DAC write, which come from interrupts
+ *
+ *	\param event The event
+ */
+ void latency_mark_from_isr(LATENCY_EVENT event)
+ {
+	UBaseType_t interrupt_mask = taskENTER_CRITICAL_FROM_ISR();
+	record_event(event);
+	taskEXIT_CRITICAL_FROM_ISR(interrupt_mask);
+ }
+
+ /*
+ *	\brief Clears all histograms
+ */
+ void latency_reset(void)
+ {
+	uint8_t i;
+
+	taskENTER_CRITICAL();
+	for(i = 0; i < LATENCY_NUM_HISTOGRAMS; i++)
+	{
+		histograms[i].count = 0;
+		memset(histograms[i].buckets, 0, sizeof(histograms[i].buckets));
+	}
+	wake_seen = false;
+	taskEXIT_CRITICAL();
+ }
+
+ /*
+ *	\brief Packs all histograms, each as bucket start, bucket width, count, min, max, buckets
+ *
+ *	\param buff The buffer to fill, LATENCY_NUM_HISTOGRAMS * LATENCY_HISTOGRAM_SIZE long
+ *
+ *	\return The packed length
+ */
+ uint16_t latency_pack_histograms(uint8_t * buff)
+ {
+	uint8_t i;
+	uint16_t length = 0;
+
+	taskENTER_CRITICAL();
+	for(i = 0; i < LATENCY_NUM_HISTOGRAMS; i++)
+	{
+		latency_histogram_t * hist = &histograms[i];
+		memcpy(&buff[length], &hist->bucket_start_us, 4);
+		memcpy(&buff[length+4], &hist->bucket_width_us, 2);
+		memcpy(&buff[length+6], &hist->count, 4);
+		memcpy(&buff[length+10], &hist->min_us, 4);
+		memcpy(&buff[length+14], &hist->max_us, 4);
+		memcpy(&buff[length+18], hist->buckets, sizeof(hist->buckets));
+		length += LATENCY_HISTOGRAM_SIZE;
+	}
+	taskEXIT_CRITICAL();
+	return length;
+ }
\ No newline at end of file
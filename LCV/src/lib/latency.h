@@ -0,0 +1,68 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file latency.h
+ *
+ * \brief Control loop jitter and sample to actuation latency histograms
+ *
+ */
+
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#define LATENCY_NUM_BUCKETS			(16)	// First and last buckets also take everything beyond them
+#define LATENCY_HISTOGRAM_SIZE		(18 + (2 * LATENCY_NUM_BUCKETS))	// Packed size, see latency_pack_histograms
+
+#define LATENCY_PERIOD_NOMINAL_US	(10000)	// Control period
+
+/*
+*	\brief Enumeration of timestamped events
+*/
+typedef enum
+{
+	LATENCY_ADC_DONE = 0,
+	LATENCY_CONTROL_WAKE = 1,
+	LATENCY_CONTROLLER_OUTPUT = 2,
+	LATENCY_DAC_WRITE = 3,
+	LATENCY_NUM_EVENTS = 4
+} LATENCY_EVENT;
+
+/*
+*	\brief Enumeration of histograms
+*/
+typedef enum
+{
+	LATENCY_HIST_PERIOD_JITTER = 0,		// Wake to wake period minus nominal
+	LATENCY_HIST_WAKE_TO_DAC = 1,		// Control wake to DAC write
+	LATENCY_HIST_SAMPLE_TO_DAC = 2,		// Completion of the ADC scan used to DAC write
+	LATENCY_HIST_WAKE_TO_OUTPUT = 3,	// Control wake to controller output, the controller's compute time
+	LATENCY_NUM_HISTOGRAMS = 4
+} LATENCY_HISTOGRAM;
+
+void latency_mark(LATENCY_EVENT event);
+void latency_mark_from_isr(LATENCY_EVENT event);
+void latency_reset(void);
+uint16_t latency_pack_histograms(uint8_t * buff);
+
+#endif /* LATENCY_H_ */
\ No newline at end of file
@@ -34,6 +34,7 @@ SOFTWARE.*/
  #include "../task_control.h"
 
  #include "alarm_monitoring.h"
+ #include "lung_mechanics.h"
 
  #include "lcd_interface.h"
 
@@ -293,6 +294,12 @@ void update_main_buffer(lcv_parameters_t * new_settings,  SETTINGS_INPUT_STAGE s
 	switch (stage)
 	{
 		case STAGE_NONE:
+			// Patient mechanics in the settings line when it is free, ml/cmH2O and cmH2O/(L/s)
+			if(lung_mechanics_is_valid())
+			{
+				snprintf(&main_screen_buffer[60], 20, "C:%i R:%i", (int) (lung_mechanics_get_compliance_ml_cm_h2o() + 0.5),
+					(int) (lung_mechanics_get_resistance_cm_h2o_s_liter() + 0.5));
+			}
 			break;
 
 		case STAGE_BPM:
@@ -310,6 +317,14 @@ void update_main_buffer(lcv_parameters_t * new_settings,  SETTINGS_INPUT_STAGE s
 		case STAGE_IE:
 			sprintf(&main_screen_buffer[60], "SET I:E: %i.%i:1", setting_inspiratory_ones, setting_inspiratory_tenths);
 			break;
+
+		case STAGE_RISE:
+			sprintf(&main_screen_buffer[60], "SET RISE:%ims", (int) new_settings->rise_time_ms);
+			break;
+
+		case STAGE_FALL:
+			sprintf(&main_screen_buffer[60], "SET FALL:%ims", (int) new_settings->fall_time_ms);
+			break;
 		
 		default:
 			break;
@@ -354,4 +369,9 @@ void update_alarm_buffer(void)
 	{
 		snprintf(&alarm_screen_buffer[60],10,"P RISE");
 	}
+
+	if(check_alarm(ALARM_OVERPRESSURE))
+	{
+		snprintf(&alarm_screen_buffer[70],10,"OVER PRES");
+	}
 }
\ No newline at end of file
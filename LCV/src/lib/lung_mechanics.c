@@ -0,0 +1,210 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file lung_mechanics.c
+ *
+ * \brief Online estimate of lung compliance and airway resistance
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "telemetry.h"
+
+ #include "lung_mechanics.h"
+
+ /*
+ *	Single compartment model, pressure = R * flow + E * volume + P0, with elastance E = 1 / C.
+ *	Recursive least squares with forgetting fits R, E and P0 one flow sample at a time. There
+ *	is no FPU, so the filter runs in fixed point: the parameters, regressors and pressure in
+ *	Q16, the covariance in Q24, products and quotients through 64 bits.
+ */
+ #define LUNG_Q16					(16)
+ #define LUNG_Q24					(24)
+ #define LUNG_ONE_Q24				((int64_t) 1 << LUNG_Q24)
+ #define LUNG_FORGETTING_Q24			((int64_t) (LUNG_MECHANICS_FORGETTING * (1 << LUNG_Q24)))
+ #define LUNG_FORGETTING_INV_Q24		((int64_t) ((1 << LUNG_Q24) / LUNG_MECHANICS_FORGETTING))
+ #define LUNG_COVARIANCE_MAX_Q24		((int32_t) 100 << LUNG_Q24)	// Prior, and the cap while unexcited
+
+ #define LUNG_NUM_PARAMETERS			(3)
+
+ static int32_t theta[LUNG_NUM_PARAMETERS];		// R, E, P0 in Q16
+ static int32_t covariance[LUNG_NUM_PARAMETERS][LUNG_NUM_PARAMETERS];
+ static uint32_t samples = 0;
+
+ static bool estimate_valid = false;
+ static float compliance_ml_cm_h2o = 0.0;
+ static float resistance_cm_h2o_s_liter = 0.0;
+
+ static int32_t to_q16(float value)
+ {
+	return (int32_t) (value * (1 << LUNG_Q16));
+ }
+
+ /*
+ *	\brief Starts the fit from typical adult values and registers telemetry
+ */
+ void lung_mechanics_init(void)
+ {
+	uint8_t i, j;
+
+	theta[0] = to_q16(10.0);	// cm-H2O per L/s
+	theta[1] = to_q16(20.0);	// cm-H2O per L, 50 ml per cm-H2O
+	theta[2] = to_q16(5.0);
+	for(i = 0; i < LUNG_NUM_PARAMETERS; i++)
+	{
+		for(j = 0; j < LUNG_NUM_PARAMETERS; j++)
+		{
+			covariance[i][j] = (i == j) ? LUNG_COVARIANCE_MAX_Q24 : 0;
+		}
+	}
+	samples = 0;
+
+	telemetry_register(TELEMETRY_COMPLIANCE, TELEMETRY_FLOAT, &compliance_ml_cm_h2o);
+	telemetry_register(TELEMETRY_RESISTANCE, TELEMETRY_FLOAT, &resistance_cm_h2o_s_liter);
+ }
+
+ /*
+ *	\brief Runs one recursive least squares step, call per flow sample
+ *
+ *	\param pressure_cm_h2o Airway pressure
+ *	\param flow_liter_s Flow, positive into the patient
+ *	\param volume_liter Volume into the patient since any fixed point of the breath
+ */
+ void lung_mechanics_update(float pressure_cm_h2o, float flow_liter_s, float volume_liter)
+ {
+	int32_t regressor[LUNG_NUM_PARAMETERS] = {to_q16(flow_liter_s), to_q16(volume_liter), 1 << LUNG_Q16};
+	int64_t covariance_regressor[LUNG_NUM_PARAMETERS];	// Q24
+	int64_t gain[LUNG_NUM_PARAMETERS];					// Q24
+	uint8_t i, j;
+
+	// P * phi and lambda + phi' * P * phi
+	int64_t denominator = LUNG_FORGETTING_Q24;
+	for(i = 0; i < LUNG_NUM_PARAMETERS; i++)
+	{
+		int64_t sum = 0;
+		for(j = 0; j < LUNG_NUM_PARAMETERS; j++)
+		{
+			sum += (int64_t) covariance[i][j] * regressor[j];
+		}
+		covariance_regressor[i] = sum >> LUNG_Q16;
+		denominator += (covariance_regressor[i] * regressor[i]) >> LUNG_Q16;
+	}
+
+	// Prediction error, Q16
+	int64_t predicted = 0;
+	for(i = 0; i < LUNG_NUM_PARAMETERS; i++)
+	{
+		predicted += (int64_t) theta[i] * regressor[i];
+	}
+	int64_t error = to_q16(pressure_cm_h2o) - (predicted >> LUNG_Q16);
+
+	for(i = 0; i < LUNG_NUM_PARAMETERS; i++)
+	{
+		gain[i] = (covariance_regressor[i] << LUNG_Q24) / denominator;
+		theta[i] += (int32_t) ((gain[i] * error) >> LUNG_Q24);
+	}
+
+	// P = (P - K * phi' * P) / lambda, symmetric so work out the upper triangle. With no
+	// excitation forgetting only grows P, so hold it at the prior instead
+	bool forget = true;
+	for(i = 0; i < LUNG_NUM_PARAMETERS; i++)
+	{
+		if(covariance[i][i] >= LUNG_COVARIANCE_MAX_Q24)
+		{
+			forget = false;
+		}
+	}
+	for(i = 0; i < LUNG_NUM_PARAMETERS; i++)
+	{
+		for(j = i; j < LUNG_NUM_PARAMETERS; j++)
+		{
+			int64_t updated = covariance[i][j] - (((gain[i] >> 4) * (covariance_regressor[j] >> 4)) >> (LUNG_Q24 - 8));
+			if(forget)
+			{
+				updated = (updated * LUNG_FORGETTING_INV_Q24) >> LUNG_Q24;
+			}
+			if(i == j && updated < 1)
+			{
+				updated = 1;
+			}
+			covariance[i][j] = (int32_t) updated;
+			covariance[j][i] = (int32_t) updated;
+		}
+	}
+
+	samples++;
+ }
+
+ /*
+ *	\brief Publishes the fit as compliance and resistance, call once per breath
+ */
+ void lung_mechanics_end_of_breath(void)
+ {
+	if(samples < LUNG_MECHANICS_MIN_SAMPLES || theta[1] <= 0)
+	{
+		estimate_valid = false;
+		return;
+	}
+
+	float compliance = 1000.0 * (1 << LUNG_Q16) / (float) theta[1];
+	float resistance = theta[0] / (float) (1 << LUNG_Q16);
+
+	estimate_valid = (compliance >= LUNG_COMPLIANCE_MIN_ML_CM_H2O && compliance <= LUNG_COMPLIANCE_MAX_ML_CM_H2O &&
+		resistance >= LUNG_RESISTANCE_MIN_CM_H2O_S_L && resistance <= LUNG_RESISTANCE_MAX_CM_H2O_S_L);
+	if(estimate_valid)
+	{
+		compliance_ml_cm_h2o = compliance;
+		resistance_cm_h2o_s_liter = resistance;
+	}
+ }
+
+ /*
+ *	\brief Checks the last published estimate came from a fit that makes sense
+ *
+ *	\return True if compliance and resistance can be used
+ */
+ bool lung_mechanics_is_valid(void)
+ {
+	return estimate_valid;
+ }
+
+ /*
+ *	\brief Gets the compliance, updated each breath
+ *
+ *	\return Compliance in ml per cm-H2O
+ */
+ float lung_mechanics_get_compliance_ml_cm_h2o(void)
+ {
+	return compliance_ml_cm_h2o;
+ }
+
+ /*
+ *	\brief Gets the airway resistance, updated each breath
+ *
+ *	\return Resistance in cm-H2O per L/s
+ */
+ float lung_mechanics_get_resistance_cm_h2o_s_liter(void)
+ {
+	return resistance_cm_h2o_s_liter;
+ }
\ No newline at end of file
@@ -0,0 +1,50 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file lung_mechanics.h
+ *
+ * \brief Online estimate of lung compliance and airway resistance
+ *
+ */
+
+
+#ifndef LUNG_MECHANICS_H_
+#define LUNG_MECHANICS_H_
+
+#define LUNG_MECHANICS_FORGETTING		(0.995)	// Per flow sample, remembers about two seconds
+#define LUNG_MECHANICS_MIN_SAMPLES		(300)	// Before the first estimate is published
+
+// Estimates outside these are a poor fit, not a patient
+#define LUNG_COMPLIANCE_MIN_ML_CM_H2O	(5.0)
+#define LUNG_COMPLIANCE_MAX_ML_CM_H2O	(200.0)
+#define LUNG_RESISTANCE_MIN_CM_H2O_S_L	(0.5)
+#define LUNG_RESISTANCE_MAX_CM_H2O_S_L	(100.0)
+
+void lung_mechanics_init(void);
+void lung_mechanics_update(float pressure_cm_h2o, float flow_liter_s, float volume_liter);
+void lung_mechanics_end_of_breath(void);
+bool lung_mechanics_is_valid(void);
+float lung_mechanics_get_compliance_ml_cm_h2o(void);
+float lung_mechanics_get_resistance_cm_h2o_s_liter(void);
+
+#endif /* LUNG_MECHANICS_H_ */
\ No newline at end of file
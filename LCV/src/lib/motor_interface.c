@@ -28,14 +28,24 @@ SOFTWARE.*/
  */
 
  #include "../task_monitor.h"
+ #include "../task_hmi.h"
 
  #include "adc_interface.h"
  #include "alarm_monitoring.h"
+ #include "latency.h"
+ #include "motor_speed.h"
+ #include "motor_thermal.h"
+ #include "telemetry.h"
 
  #include "motor_interface.h"
 
  static struct dac_module module;
 
+ static float command_filt = 0.0;
+ static uint16_t dac_out = 0;
+ static volatile bool overpressure_latched = false;
+ static volatile bool dac_ready = false;
+
  void init_motor_interface(void)
  {
 	disable_motor();
@@ -57,8 +67,14 @@ SOFTWARE.*/
 	dac_chan_enable(&module, DAC_CHANNEL_0);
 
 	dac_enable(&module);
+	dac_ready = true;
+
+	telemetry_register(TELEMETRY_MOTOR_COMMAND, TELEMETRY_FLOAT, &command_filt);
+	telemetry_register(TELEMETRY_DAC_CODE, TELEMETRY_U16, &dac_out);
 
 	drive_motor(0.0);
+
+	motor_speed_init();
  }
 
  void motor_status_monitor(void)
@@ -72,21 +88,24 @@ SOFTWARE.*/
 	{
 		set_alarm(ALARM_MOTOR_ERROR, false);
 	}*/
-	set_alarm(ALARM_MOTOR_ERROR, false);
+	set_alarm(ALARM_MOTOR_ERROR, motor_speed_check_stall(command_filt));
 
-	if(get_motor_temp_celsius() > 100)
-	{
-		set_alarm(ALARM_MOTOR_TEMP, true);
-	}
-	else
-	{
-		set_alarm(ALARM_MOTOR_TEMP, false);
-	}
+	// Warns on the trend, ahead of the limit
+	motor_thermal_update(MOTOR_STATUS_PERIOD_S);
+	set_alarm(ALARM_MOTOR_TEMP, motor_thermal_is_warning());
+
+	set_alarm(ALARM_OVERPRESSURE, overpressure_latched);
  }
 
  void enable_motor(void)
  {
-	ioport_set_pin_level(MOTOR_ENABLE_GPIO, MOTOR_ENABLE_ACTIVE_LEVEL);
+	// The cutoff and enable switch interrupts must not land between the check and the write
+	taskENTER_CRITICAL();
+	if(!overpressure_latched && system_is_enabled())
+	{
+		ioport_set_pin_level(MOTOR_ENABLE_GPIO, MOTOR_ENABLE_ACTIVE_LEVEL);
+	}
+	taskEXIT_CRITICAL();
  }
 
  void disable_motor(void)
@@ -107,9 +126,8 @@ SOFTWARE.*/
 		command = 0.9999;
 	}
 
-	static float command_filt = 0.0;
-	float alpha_down = 0.99;
-	float alpha_up = 0.8;
+	float alpha_down = MOTOR_COMMAND_ALPHA_DOWN;
+	float alpha_up = MOTOR_COMMAND_ALPHA_UP;
 
 	if(command >= last_command)
 	{
@@ -122,8 +140,67 @@ SOFTWARE.*/
 
 	last_command = command_filt;
 
-	uint16_t dac_out = (uint16_t) (command_filt * 1023.0);
+	taskENTER_CRITICAL();
+	if(overpressure_latched)
+	{
+		// Restart from zero once cleared
+		command_filt = 0.0;
+		last_command = 0.0;
+	}
+	dac_out = (uint16_t) (command_filt * 1023.0);
 	dac_out &= (0x3ff);
 	dac_chan_write(&module, DAC_CHANNEL_0, dac_out);
+	taskEXIT_CRITICAL();
+
+	latency_mark(LATENCY_DAC_WRITE);
 	return command_filt;
+ }
+
+ /*
+ *	\brief Writes a command straight to the DAC without the slew filter. ISR context
+ *
+ *	For the inner speed loop, which does its own shaping
+ *
+ *	\param command The motor command, 0 to 1
+ */
+ void drive_motor_from_isr(float command)
+ {
+	if(command < 0.0)
+	{
+		command = 0.0;
+	}
+	if(command > 1.0)
+	{
+		command = 0.9999;
+	}
+
+	UBaseType_t interrupt_mask = taskENTER_CRITICAL_FROM_ISR();
+	command_filt = overpressure_latched ? 0.0 : command;
+	dac_out = (uint16_t) (command_filt * 1023.0);
+	dac_out &= (0x3ff);
+	dac_chan_write(&module, DAC_CHANNEL_0, dac_out);
+	taskEXIT_CRITICAL_FROM_ISR(interrupt_mask);
+ }
+
+ /*
+ *	\brief Stops the motor and latches the overpressure alarm. ISR context
+ *
+ *	Zeroes the DAC and drops the enable line without going through the RTOS
+ */
+ void motor_overpressure_cutoff(void)
+ {
+	overpressure_latched = true;
+	ioport_set_pin_level(MOTOR_ENABLE_GPIO, !MOTOR_ENABLE_ACTIVE_LEVEL);
+	if(dac_ready)
+	{
+		dac_chan_write(&module, DAC_CHANNEL_0, 0);
+	}
+ }
+
+ /*
+ *	\brief Releases the overpressure latch, trips again on the next scan if still over the limit
+ */
+ void motor_overpressure_clear(void)
+ {
+	overpressure_latched = false;
  }
\ No newline at end of file
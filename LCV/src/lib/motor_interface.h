@@ -31,10 +31,17 @@ SOFTWARE.*/
 #ifndef MOTOR_INTERFACE_H_
 #define MOTOR_INTERFACE_H_
 
+#define MOTOR_STATUS_PERIOD_S	(0.01)	// motor_status_monitor runs each control cycle
+#define MOTOR_COMMAND_ALPHA_UP		(0.8)	// drive_motor slew filter, per control cycle
+#define MOTOR_COMMAND_ALPHA_DOWN	(0.99)
+
 void init_motor_interface(void);
 void motor_status_monitor(void);
 void enable_motor(void);
 void disable_motor(void);
 float drive_motor(float command);
+void drive_motor_from_isr(float command);
+void motor_overpressure_cutoff(void);
+void motor_overpressure_clear(void);
 
 #endif /* MOTOR_INTERFACE_H_ */
\ No newline at end of file
@@ -0,0 +1,303 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file motor_speed.c
+ *
+ * \brief Blower speed capture and inner speed loop
+ *
+ */
+
+ #include <string.h>
+
+ #include "../task_monitor.h"
+
+ #include "motor_interface.h"
+ #include "telemetry.h"
+ #include "latency.h"
+
+ #include "motor_speed.h"
+
+ #define MOTOR_SPEED_LOOP_DT_S		(0.001)	// Tick hook rate
+ #define MOTOR_SPEED_LOOP_AUTHORITY	(0.2)	// Most the loop may move the command off the feedforward
+
+ static volatile uint16_t pulse_period_us[MOTOR_SPEED_PULSES_PER_REV];
+ static volatile uint8_t pulse_index = 0;
+ static volatile uint8_t pulse_count = 0;
+ static volatile uint32_t rev_period_us = 0;	// 0 while stopped
+ static volatile bool restarted = true;
+ static volatile bool tach_seen = false;
+
+ static float speed_rpm = 0.0;
+
+ static volatile bool loop_running = false;
+ static volatile float loop_set_point = 0.0;
+ static volatile bool loop_set_point_new = false;	// First write of a new set point closes the latency measurement
+ static float loop_integral = 0.0;
+
+ /*
+ *	\brief Routes the tach edges through the event system into a TC period capture
+ *
+ *	The TC restarts on every rising edge with the time since the last one in CC0, so
+ *	capture needs no CPU. An overflow means no edge for 65 ms, which is treated as stopped.
+ */
+ void motor_speed_init(void)
+ {
+	struct extint_chan_conf config_extint_chan;
+	struct extint_events events;
+
+	extint_chan_get_config_defaults(&config_extint_chan);
+	config_extint_chan.gpio_pin = PIN_PA18A_EIC_EXTINT2;
+	config_extint_chan.gpio_pin_mux = MUX_PA18A_EIC_EXTINT2;
+	config_extint_chan.gpio_pin_pull = EXTINT_PULL_UP;	// Open collector output
+	config_extint_chan.detection_criteria = EXTINT_DETECT_RISING;
+	config_extint_chan.filter_input_signal = true;
+	extint_chan_set_config(MOTOR_SPEED_EXTINT, &config_extint_chan);
+
+	memset(&events, 0, sizeof(events));
+	events.generate_event_on_detect[MOTOR_SPEED_EXTINT] = true;
+	extint_enable_events(&events);
+
+	// Asynchronous path, no event clock needed
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_EVSYS | PM_APBCMASK_TC3);
+	EVSYS->USER.reg = EVSYS_USER_USER(EVSYS_ID_USER_TC3_EVU) | EVSYS_USER_CHANNEL(MOTOR_SPEED_EVSYS_CHANNEL + 1);
+	EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(MOTOR_SPEED_EVSYS_CHANNEL) | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_2) |
+		EVSYS_CHANNEL_PATH_ASYNCHRONOUS;
+
+	struct system_gclk_chan_config gclk_config;
+	system_gclk_chan_get_config_defaults(&gclk_config);
+	gclk_config.source_generator = GCLK_GENERATOR_1;	// 8 MHz
+	system_gclk_chan_set_config(MOTOR_SPEED_TC_GCLK_ID, &gclk_config);
+	system_gclk_chan_enable(MOTOR_SPEED_TC_GCLK_ID);
+
+	MOTOR_SPEED_TC->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+	while(MOTOR_SPEED_TC->COUNT16.CTRLA.reg & TC_CTRLA_SWRST);
+
+	// 1 MHz, period in CC0 and pulse width in CC1
+	MOTOR_SPEED_TC->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV8;
+	while(MOTOR_SPEED_TC->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+	MOTOR_SPEED_TC->COUNT16.CTRLC.reg = TC_CTRLC_CPTEN0 | TC_CTRLC_CPTEN1;
+	while(MOTOR_SPEED_TC->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+	MOTOR_SPEED_TC->COUNT16.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_PPW;
+	MOTOR_SPEED_TC->COUNT16.INTENSET.reg = TC_INTENSET_MC0 | TC_INTENSET_OVF;
+
+	irq_register_handler(MOTOR_SPEED_TC_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+
+	MOTOR_SPEED_TC->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+	while(MOTOR_SPEED_TC->COUNT16.STATUS.reg & TC_STATUS_SYNCBUSY);
+
+	telemetry_register(TELEMETRY_MOTOR_RPM, TELEMETRY_FLOAT, &speed_rpm);
+ }
+
+ void TC3_Handler(void)
+ {
+	uint8_t flags = MOTOR_SPEED_TC->COUNT16.INTFLAG.reg;
+
+	if(flags & TC_INTFLAG_OVF)
+	{
+		MOTOR_SPEED_TC->COUNT16.INTFLAG.reg = TC_INTFLAG_OVF;
+		pulse_count = 0;
+		rev_period_us = 0;
+		restarted = true;
+	}
+
+	if(flags & TC_INTFLAG_MC0)
+	{
+		// Reading CC0 clears the flag
+		uint16_t period = MOTOR_SPEED_TC->COUNT16.CC[0].reg;
+		tach_seen = true;
+
+		if(restarted)
+		{
+			// Counter ran freely up to this edge, so the period is not real
+			restarted = false;
+		}
+		else
+		{
+			// Sum a whole revolution so uneven pole spacing cancels out
+			pulse_period_us[pulse_index] = period;
+			pulse_index = (pulse_index + 1) % MOTOR_SPEED_PULSES_PER_REV;
+			if(pulse_count < MOTOR_SPEED_PULSES_PER_REV)
+			{
+				pulse_count++;
+			}
+			if(pulse_count == MOTOR_SPEED_PULSES_PER_REV)
+			{
+				uint32_t sum = 0;
+				uint8_t i;
+				for(i = 0; i < MOTOR_SPEED_PULSES_PER_REV; i++)
+				{
+					sum += pulse_period_us[i];
+				}
+				rev_period_us = sum;
+			}
+		}
+	}
+
+ }
+
+ /*
+ *	\brief Gets the blower speed from the last revolution
+ *
+ *	\return Speed in rpm, 0 if stopped or below about 460 rpm
+ */
+ float motor_speed_get_rpm(void)
+ {
+	uint32_t period = rev_period_us;
+	if(period == 0)
+	{
+		return 0.0;
+	}
+	return 60000000.0 / (float) period;
+ }
+
+ /*
+ *	\brief Checks that the blower turns when driven, call once per control cycle
+ *
+ *	Also refreshes the logged speed
+ *
+ *	\param command The motor command being output, 0 to 1
+ *
+ *	\return True if the blower has been stopped under load for MOTOR_SPEED_STALL_MS
+ */
+ bool motor_speed_check_stall(float command)
+ {
+	static bool stalled_timing = false;
+	static TickType_t stalled_since = 0;
+
+	speed_rpm = motor_speed_get_rpm();
+
+	// No tach fitted, or turning, or not asked to
+	if(!tach_seen || command < MOTOR_SPEED_STALL_COMMAND || speed_rpm > 0.0)
+	{
+		stalled_timing = false;
+		return false;
+	}
+
+	if(!stalled_timing)
+	{
+		stalled_timing = true;
+		stalled_since = xTaskGetTickCount();
+	}
+	return (xTaskGetTickCount() - stalled_since) >= pdMS_TO_TICKS(MOTOR_SPEED_STALL_MS);
+ }
+
+ /*
+ *	\brief Hands the DAC to the inner loop, no effect unless MOTOR_SPEED_LOOP_ENABLE is set
+ */
+ void motor_speed_loop_start(void)
+ {
+	if(!MOTOR_SPEED_LOOP_ENABLE || loop_running)
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL();
+	loop_integral = 0.0;
+	loop_running = true;
+	taskEXIT_CRITICAL();
+ }
+
+ /*
+ *	\brief Takes the DAC back from the inner loop, no more loop writes once this returns
+ */
+ void motor_speed_loop_stop(void)
+ {
+	loop_running = false;
+ }
+
+ /*
+ *	\brief Checks if the inner loop owns the DAC
+ *
+ *	\return True if running
+ */
+ bool motor_speed_loop_is_running(void)
+ {
+	return loop_running;
+ }
+
+ /*
+ *	\brief Sets the inner loop set point from the outer loop output
+ *
+ *	\param speed_fraction Portion of MOTOR_SPEED_MAX_RPM, 0 to 1
+ */
+ void motor_speed_loop_set_point(float speed_fraction)
+ {
+	loop_set_point = speed_fraction;
+	loop_set_point_new = true;
+ }
+
+ /*
+ *	\brief Runs one step of the inner speed loop. Tick hook context
+ *
+ *	Feedforward of the set point with a PI trim limited to MOTOR_SPEED_LOOP_AUTHORITY,
+ *	so a lost tach leaves the blower on the feedforward alone. The trim holds while
+ *	there is no speed reading, as when spinning up from stopped.
+ */
+ void motor_speed_loop_tick(void)
+ {
+	if(!loop_running)
+	{
+		return;
+	}
+
+	float set_point = loop_set_point;
+	float command = set_point;
+	uint32_t period = rev_period_us;
+
+	if(period != 0)
+	{
+		float error_rpm = set_point * MOTOR_SPEED_MAX_RPM - 60000000.0 / (float) period;
+
+		loop_integral += MOTOR_SPEED_LOOP_KI * error_rpm * MOTOR_SPEED_LOOP_DT_S;
+		if(loop_integral > MOTOR_SPEED_LOOP_AUTHORITY)
+		{
+			loop_integral = MOTOR_SPEED_LOOP_AUTHORITY;
+		}
+		else if(loop_integral < -MOTOR_SPEED_LOOP_AUTHORITY)
+		{
+			loop_integral = -MOTOR_SPEED_LOOP_AUTHORITY;
+		}
+
+		float trim = MOTOR_SPEED_LOOP_KP * error_rpm + loop_integral;
+		if(trim > MOTOR_SPEED_LOOP_AUTHORITY)
+		{
+			trim = MOTOR_SPEED_LOOP_AUTHORITY;
+		}
+		else if(trim < -MOTOR_SPEED_LOOP_AUTHORITY)
+		{
+			trim = -MOTOR_SPEED_LOOP_AUTHORITY;
+		}
+		command += trim;
+	}
+	else
+	{
+		command += loop_integral;
+	}
+
+	drive_motor_from_isr(command);
+	if(loop_set_point_new)
+	{
+		loop_set_point_new = false;
+		latency_mark_from_isr(LATENCY_DAC_WRITE);
+	}
+ }
\ No newline at end of file
@@ -0,0 +1,61 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file motor_speed.h
+ *
+ * \brief Blower speed capture and inner speed loop
+ *
+ */
+
+
+#ifndef MOTOR_SPEED_H_
+#define MOTOR_SPEED_H_
+
+#define MOTOR_SPEED_TC				TC3
+#define MOTOR_SPEED_TC_GCLK_ID		TC3_GCLK_ID
+#define MOTOR_SPEED_TC_IRQn			TC3_IRQn
+#define MOTOR_SPEED_EXTINT			(2)		// PA18
+#define MOTOR_SPEED_EVSYS_CHANNEL	(0)
+
+#define MOTOR_SPEED_PULSES_PER_REV	(2)		// Driver tach output, check against the driver setting
+#define MOTOR_SPEED_MAX_RPM			(40000.0)	// Speed at full DAC command, scales the outer loop output
+
+// Stall detection, only once the tach has been seen so an unwired tach does not alarm
+#define MOTOR_SPEED_STALL_COMMAND	(0.2)	// Commands above this must turn the blower
+#define MOTOR_SPEED_STALL_MS		(300)
+
+// Cascaded control, the pressure loop output becomes a speed set point for a 1 kHz inner loop
+#define MOTOR_SPEED_LOOP_ENABLE		(0)		// Set to 1 once the tach is wired and the gains are tuned
+#define MOTOR_SPEED_LOOP_KP			(0.00002)	// Per rpm of error
+#define MOTOR_SPEED_LOOP_KI			(0.0004)	// Per rpm second of error
+
+void motor_speed_init(void);
+float motor_speed_get_rpm(void);
+bool motor_speed_check_stall(float command);
+void motor_speed_loop_start(void);
+void motor_speed_loop_stop(void);
+bool motor_speed_loop_is_running(void);
+void motor_speed_loop_set_point(float speed_fraction);
+void motor_speed_loop_tick(void);
+
+#endif /* MOTOR_SPEED_H_ */
\ No newline at end of file
@@ -0,0 +1,145 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file motor_thermal.c
+ *
+ * \brief Motor temperature trend and derating
+ *
+ */
+
+ #include <math.h>
+
+ #include "../task_monitor.h"
+
+ #include "adc_interface.h"
+ #include "telemetry.h"
+
+ #include "motor_thermal.h"
+
+ #define THERMAL_TEMP_FILTER_S		(2.0)	// Smooths the NTC reading before taking a slope
+ #define THERMAL_RATE_INTERVAL_S		(5.0)	// Slope taken over this, the temperature moves slowly
+
+ static bool started = false;
+ static float temp_filt_c = 0.0;
+ static float rate_c_per_s = 0.0;
+ static float rate_reference_c = 0.0;
+ static float rate_elapsed_s = 0.0;
+ static float predicted_c = 0.0;
+
+ /*
+ *	\brief Filters the motor temperature and projects its trend, call once per control cycle
+ *
+ *	With a first order response the temperature heads for T + tau * dT/dt. The prediction
+ *	is where it gets to within MOTOR_THERMAL_WARN_HORIZON_S on that path.
+ *
+ *	\param dt_s Time since the last call in seconds
+ */
+ void motor_thermal_update(float dt_s)
+ {
+	if(!adc_has_scanned())
+	{
+		return;
+	}
+
+	float temp_c = get_motor_temp_celsius();
+
+	if(!started)
+	{
+		temp_filt_c = temp_c;
+		rate_reference_c = temp_c;
+		predicted_c = temp_c;
+		telemetry_register(TELEMETRY_MOTOR_TEMP, TELEMETRY_FLOAT, &temp_filt_c);
+		telemetry_register(TELEMETRY_MOTOR_TEMP_PREDICTED, TELEMETRY_FLOAT, &predicted_c);
+		started = true;
+		return;
+	}
+
+	temp_filt_c += (dt_s / (THERMAL_TEMP_FILTER_S + dt_s)) * (temp_c - temp_filt_c);
+
+	rate_elapsed_s += dt_s;
+	if(rate_elapsed_s >= THERMAL_RATE_INTERVAL_S)
+	{
+		float rate = (temp_filt_c - rate_reference_c) / rate_elapsed_s;
+		rate_c_per_s = 0.7 * rate_c_per_s + 0.3 * rate;
+		rate_reference_c = temp_filt_c;
+		rate_elapsed_s = 0.0;
+	}
+
+	float final_c = temp_filt_c + MOTOR_THERMAL_TIME_CONSTANT_S * rate_c_per_s;
+	float horizon_portion = 1.0 - expf(-MOTOR_THERMAL_WARN_HORIZON_S / MOTOR_THERMAL_TIME_CONSTANT_S);
+	predicted_c = temp_filt_c + (final_c - temp_filt_c) * horizon_portion;
+ }
+
+ /*
+ *	\brief Gets the filtered motor temperature
+ *
+ *	\return The temperature in Celsius
+ */
+ float motor_thermal_get_temp_celsius(void)
+ {
+	return temp_filt_c;
+ }
+
+ /*
+ *	\brief Gets the temperature the trend reaches within MOTOR_THERMAL_WARN_HORIZON_S
+ *
+ *	\return The temperature in Celsius
+ */
+ float motor_thermal_get_predicted_celsius(void)
+ {
+	return predicted_c;
+ }
+
+ /*
+ *	\brief Checks if the motor is over the limit or heading over it
+ *
+ *	\return True to raise ALARM_MOTOR_TEMP
+ */
+ bool motor_thermal_is_warning(void)
+ {
+	return (temp_filt_c > MOTOR_TEMP_LIMIT_C) || (predicted_c > MOTOR_TEMP_LIMIT_C);
+ }
+
+ /*
+ *	\brief Gets the highest motor command allowed at the present temperature
+ *
+ *	Full output below the derate band, so normal ventilation is untouched until the motor
+ *	is close to the limit and the warning has already been given
+ *
+ *	\return The output limit, MOTOR_THERMAL_DERATE_MIN to 1
+ */
+ float motor_thermal_output_limit(void)
+ {
+	float band_start_c = MOTOR_TEMP_LIMIT_C - 0.5 * MOTOR_THERMAL_DERATE_BAND_C;
+	if(temp_filt_c <= band_start_c)
+	{
+		return 1.0;
+	}
+
+	float portion = (temp_filt_c - band_start_c) / MOTOR_THERMAL_DERATE_BAND_C;
+	if(portion > 1.0)
+	{
+		portion = 1.0;
+	}
+	return 1.0 - portion * (1.0 - MOTOR_THERMAL_DERATE_MIN);
+ }
\ No newline at end of file
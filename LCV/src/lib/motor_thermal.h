@@ -0,0 +1,46 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file motor_thermal.h
+ *
+ * \brief Motor temperature trend and derating
+ *
+ */
+
+
+#ifndef MOTOR_THERMAL_H_
+#define MOTOR_THERMAL_H_
+
+#define MOTOR_TEMP_LIMIT_C				(100.0)
+#define MOTOR_THERMAL_TIME_CONSTANT_S	(600.0)	// First order fit of the NTC to a load step, check on the bench
+#define MOTOR_THERMAL_WARN_HORIZON_S	(120.0)	// Alarm when the trend crosses the limit within this
+#define MOTOR_THERMAL_DERATE_BAND_C		(10.0)	// Output limit falls linearly across this band, centered on the limit
+#define MOTOR_THERMAL_DERATE_MIN		(0.7)	// Output limit at the top of the band and above
+
+void motor_thermal_update(float dt_s);
+float motor_thermal_get_temp_celsius(void);
+float motor_thermal_get_predicted_celsius(void);
+bool motor_thermal_is_warning(void);
+float motor_thermal_output_limit(void);
+
+#endif /* MOTOR_THERMAL_H_ */
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file setting_input.c
+ *
+ * \brief Front panel knob, potentiometer or quadrature encoder
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "adc_interface.h"
+
+ #include "setting_input.h"
+
+ #if INPUT_KNOB_IS_ENCODER
+
+ #define ENCODER_A_EXTINT			(10)
+ #define ENCODER_B_EXTINT			(4)
+
+ // Count change for each previous and current AB state, 0 for no change or a skipped state
+ static const int8_t quadrature_table[16] =
+ {
+	0, -1, 1, 0,
+	1, 0, 0, -1,
+	-1, 0, 0, 1,
+	0, 1, -1, 0
+ };
+
+ static volatile uint8_t encoder_state = 0;
+ static volatile int8_t encoder_counts = 0;
+ static volatile int32_t encoder_steps = 0;
+ static TickType_t last_detent_tick = 0;
+
+ static uint8_t read_encoder_state(void)
+ {
+	return (ioport_get_pin_level(INPUT_ENCODER_A_GPIO) ? 2 : 0) | (ioport_get_pin_level(INPUT_ENCODER_B_GPIO) ? 1 : 0);
+ }
+
+ /*
+ *	\brief Encoder edge on either channel, counts detents weighted by turning speed
+ */
+ static void encoder_extint_cb(void)
+ {
+	uint8_t state = read_encoder_state();
+	encoder_counts += quadrature_table[(encoder_state << 2) | state];
+	encoder_state = state;
+
+	if(encoder_counts >= ENCODER_COUNTS_PER_DETENT || encoder_counts <= -ENCODER_COUNTS_PER_DETENT)
+	{
+		TickType_t now = xTaskGetTickCountFromISR();
+		uint32_t interval_ms = (now - last_detent_tick) * portTICK_PERIOD_MS;
+		int32_t steps = 1;
+
+		if(interval_ms < ENCODER_FAST_DETENT_MS)
+		{
+			steps = ENCODER_FAST_STEPS;
+		}
+		else if(interval_ms < ENCODER_MEDIUM_DETENT_MS)
+		{
+			steps = ENCODER_MEDIUM_STEPS;
+		}
+
+		encoder_steps += (encoder_counts > 0) ? steps : -steps;
+		encoder_counts = 0;
+		last_detent_tick = now;
+	}
+ }
+
+ #endif
+
+ /*
+ *	\brief Sets up the knob, EIC interrupts on both encoder channels if fitted
+ */
+ void setting_input_init(void)
+ {
+ #if INPUT_KNOB_IS_ENCODER
+	struct extint_chan_conf config_extint_chan;
+	extint_chan_get_config_defaults(&config_extint_chan);
+	config_extint_chan.gpio_pin_pull = EXTINT_PULL_UP;
+	config_extint_chan.detection_criteria = EXTINT_DETECT_BOTH;
+	config_extint_chan.filter_input_signal = true;
+
+	config_extint_chan.gpio_pin = PIN_PB10A_EIC_EXTINT10;
+	config_extint_chan.gpio_pin_mux = MUX_PB10A_EIC_EXTINT10;
+	extint_chan_set_config(ENCODER_A_EXTINT, &config_extint_chan);
+
+	config_extint_chan.gpio_pin = PIN_PA20A_EIC_EXTINT4;
+	config_extint_chan.gpio_pin_mux = MUX_PA20A_EIC_EXTINT4;
+	extint_chan_set_config(ENCODER_B_EXTINT, &config_extint_chan);
+
+	encoder_state = read_encoder_state();
+
+	// Uses FreeRTOS, so need to limit priority
+	irq_register_handler(EIC_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+	extint_register_callback(encoder_extint_cb, ENCODER_A_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+	extint_chan_enable_callback(ENCODER_A_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+	extint_register_callback(encoder_extint_cb, ENCODER_B_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+	extint_chan_enable_callback(ENCODER_B_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+ #endif
+ }
+
+ /*
+ *	\brief Drops encoder turns not yet applied, call when the setting being edited changes
+ */
+ void setting_input_reset(void)
+ {
+ #if INPUT_KNOB_IS_ENCODER
+	taskENTER_CRITICAL();
+	encoder_steps = 0;
+	encoder_counts = 0;
+	taskEXIT_CRITICAL();
+ #endif
+ }
+
+ /*
+ *	\brief Applies the knob to a setting
+ *
+ *	An encoder moves the setting by the detents turned since the last call. The
+ *	potentiometer sets it absolutely, but only once it has moved past the current value by
+ *	SETTING_INPUT_POT_HYSTERESIS steps, so the value does not flicker between two steps.
+ *
+ *	\param current The current value of the setting
+ *	\param lower The lowest allowed value
+ *	\param upper The highest allowed value
+ *
+ *	\return The new value, within lower and upper
+ */
+ int32_t setting_input_apply(int32_t current, int32_t lower, int32_t upper)
+ {
+	int32_t value = current;
+
+ #if INPUT_KNOB_IS_ENCODER
+	taskENTER_CRITICAL();
+	value += encoder_steps;
+	encoder_steps = 0;
+	taskEXIT_CRITICAL();
+ #else
+	float position = lower + get_input_potentiometer_portion() * (upper - lower);
+	float distance = position - current;
+	if(distance > SETTING_INPUT_POT_HYSTERESIS || distance < -SETTING_INPUT_POT_HYSTERESIS)
+	{
+		value = (int32_t) (position + 0.5);
+	}
+ #endif
+
+	if(value < lower)
+	{
+		value = lower;
+	}
+	if(value > upper)
+	{
+		value = upper;
+	}
+	return value;
+ }
\ No newline at end of file
@@ -0,0 +1,46 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file setting_input.h
+ *
+ * \brief Front panel knob, potentiometer or quadrature encoder
+ *
+ */
+
+
+#ifndef SETTING_INPUT_H_
+#define SETTING_INPUT_H_
+
+#define SETTING_INPUT_POT_HYSTERESIS		(0.75)	// Steps the knob must move past the current value
+
+#define ENCODER_COUNTS_PER_DETENT			(4)
+#define ENCODER_FAST_DETENT_MS				(30)	// Detents closer than this move ENCODER_FAST_STEPS
+#define ENCODER_FAST_STEPS					(5)
+#define ENCODER_MEDIUM_DETENT_MS			(80)	// Detents closer than this move ENCODER_MEDIUM_STEPS
+#define ENCODER_MEDIUM_STEPS				(2)
+
+void setting_input_init(void);
+void setting_input_reset(void);
+int32_t setting_input_apply(int32_t current, int32_t lower, int32_t upper);
+
+#endif /* SETTING_INPUT_H_ */
\ No newline at end of file
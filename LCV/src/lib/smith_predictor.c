@@ -0,0 +1,101 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file smith_predictor.c
+ *
+ * \brief Dead time compensation for the pressure loop
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "feedforward.h"
+ #include "motor_interface.h"
+ #include "motor_speed.h"
+
+ #include "smith_predictor.h"
+
+ // The plant model is the learned feedforward map as the blower's static pressure, behind
+ // the same lags the real loop has
+ static float command_model = 0.0;				// drive_motor slew filter
+ static float delay_line[SMITH_DEAD_TIME_CYCLES];	// Transport
+ static uint8_t delay_index = 0;
+ static float sensor_model = 0.0;				// ADC filter
+ static float undelayed_model = 0.0;
+
+ /*
+ *	\brief Empties the model, for when the motor stops
+ */
+ void smith_reset(void)
+ {
+	uint8_t i;
+
+	command_model = 0.0;
+	for(i = 0; i < SMITH_DEAD_TIME_CYCLES; i++)
+	{
+		delay_line[i] = 0.0;
+	}
+	delay_index = 0;
+	sensor_model = 0.0;
+	undelayed_model = 0.0;
+ }
+
+ /*
+ *	\brief Gets the pressure the sensor would show now if the loop had no lag
+ *
+ *	The measurement, less what the lagged model says is on its way, plus what the unlagged
+ *	model says it will be. A model error still shows up in the measurement, so the loop stays
+ *	closed on the real pressure.
+ *
+ *	\param measured_cm_h2o The measured pressure
+ *
+ *	\return The predicted pressure in cm-H2O
+ */
+ float smith_predict(float measured_cm_h2o)
+ {
+	return measured_cm_h2o + undelayed_model - sensor_model;
+ }
+
+ /*
+ *	\brief Runs the model one control cycle on the command just output
+ *
+ *	\param command The motor command, 0 to 1
+ */
+ void smith_update(float command)
+ {
+	undelayed_model = feedforward_get_pressure(command);
+
+	// The inner speed loop drives the DAC without the slew filter
+	float alpha = 0.0;
+	if(!MOTOR_SPEED_LOOP_ENABLE)
+	{
+		alpha = (command >= command_model) ? MOTOR_COMMAND_ALPHA_UP : MOTOR_COMMAND_ALPHA_DOWN;
+	}
+	command_model = alpha * command_model + (1.0 - alpha) * command;
+
+	float delayed = delay_line[delay_index];
+	delay_line[delay_index] = feedforward_get_pressure(command_model);
+	delay_index = (delay_index + 1) % SMITH_DEAD_TIME_CYCLES;
+
+	sensor_model = SMITH_SENSOR_ALPHA * sensor_model + (1.0 - SMITH_SENSOR_ALPHA) * delayed;
+ }
\ No newline at end of file
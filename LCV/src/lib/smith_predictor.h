@@ -0,0 +1,41 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file smith_predictor.h
+ *
+ * \brief Dead time compensation for the pressure loop
+ *
+ */
+
+
+#ifndef SMITH_PREDICTOR_H_
+#define SMITH_PREDICTOR_H_
+
+#define SMITH_DEAD_TIME_CYCLES		(3)		// Blower and duct transport lag in control cycles, check in the logs
+#define SMITH_SENSOR_ALPHA			(0.59)	// ADC filter of 0.9 per 2 ms scan, five scans per control cycle
+
+void smith_reset(void);
+float smith_predict(float measured_cm_h2o);
+void smith_update(float command);
+
+#endif /* SMITH_PREDICTOR_H_ */
\ No newline at end of file
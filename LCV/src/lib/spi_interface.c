@@ -77,15 +77,31 @@ SOFTWARE.*/
 
  bool spi_transact(spi_transaction_t transaction)
  {
-	if(current_transaction.buffer_length > MAX_BUFFER_SIZE )
+	if(transaction.buffer_length > MAX_BUFFER_SIZE )
 	{
 		return false;
 	}
 
-	current_transaction = transaction;
-	memcpy(tx_buffer, current_transaction.tx_buff, current_transaction.buffer_length);
+	// Shared bus, so do not clobber a transaction still in flight. Callers are in several
+	// tasks, so the check and the start must not be split by a preemption
+	bool started = false;
+	taskENTER_CRITICAL();
+	if(spi_get_job_status(&spi_master_instance) != STATUS_BUSY)
+	{
+		current_transaction = transaction;
+		memcpy(tx_buffer, current_transaction.tx_buff, current_transaction.buffer_length);
+
+		spi_select_slave(&spi_master_instance, &current_transaction.slave_device, true);
+		if(spi_transceive_buffer_job(&spi_master_instance, tx_buffer, rx_buffer, current_transaction.buffer_length) == STATUS_OK)
+		{
+			started = true;
+		}
+		else
+		{
+			spi_select_slave(&spi_master_instance, &transaction.slave_device, false);
+		}
+	}
+	taskEXIT_CRITICAL();
 
-	spi_select_slave(&spi_master_instance, &current_transaction.slave_device, true);
-	spi_transceive_buffer_job(&spi_master_instance, tx_buffer, rx_buffer, current_transaction.buffer_length);
-	return true;
+	return started;
  }
\ No newline at end of file
@@ -0,0 +1,198 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file telemetry.c
+ *
+ * \brief Telemetry signal registry and subscription packer
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "usb_interface.h"
+
+ #include "telemetry.h"
+
+ typedef struct
+ {
+	volatile void * source;
+	TELEMETRY_TYPE type;
+	uint16_t decimation;	// 0 when not subscribed
+	uint16_t count;
+ } telemetry_signal_t;
+
+ // Default stream matches what was sent before subscriptions existed
+ static telemetry_signal_t signals[TELEMETRY_NUM_SIGNALS] =
+ {
+	[TELEMETRY_PRESSURE_VOTED] = { .decimation = 1 },
+	[TELEMETRY_PRESSURE_SET_POINT] = { .decimation = 1 },
+	[TELEMETRY_MOTOR_COMMAND] = { .decimation = 1 },
+ };
+
+ static uint8_t telemetry_batch[USB_FRAME_MAX_PAYLOAD_SIZE];
+ static uint16_t telemetry_batch_length = 0;
+ static uint32_t telemetry_batch_start_ms = 0;
+
+ /*
+ *	\brief Registers a signal source, done once by the module that owns the value
+ *
+ *	\param signal The signal
+ *	\param type The storage type of the source
+ *	\param source Pointer to the value, read whenever the signal is sampled
+ *
+ *	\return True if registered
+ */
+ bool telemetry_register(TELEMETRY_SIGNAL signal, TELEMETRY_TYPE type, volatile void * source)
+ {
+	if(signal >= TELEMETRY_NUM_SIGNALS || source == NULL)
+	{
+		return false;
+	}
+
+	taskENTER_CRITICAL();
+	signals[signal].type = type;
+	signals[signal].source = source;
+	taskEXIT_CRITICAL();
+	return true;
+ }
+
+ /*
+ *	\brief Subscribes to a signal
+ *
+ *	\param signal The signal
+ *	\param decimation Send every Nth sample, or 0 to unsubscribe
+ *
+ *	\return True if the signal exists
+ */
+ bool telemetry_subscribe(TELEMETRY_SIGNAL signal, uint16_t decimation)
+ {
+	if(signal >= TELEMETRY_NUM_SIGNALS)
+	{
+		return false;
+	}
+
+	taskENTER_CRITICAL();
+	signals[signal].decimation = decimation;
+	signals[signal].count = 0;
+	taskEXIT_CRITICAL();
+	return true;
+ }
+
+ /*
+ *	\brief Unsubscribes from all signals
+ */
+ void telemetry_unsubscribe_all(void)
+ {
+	uint8_t i;
+	taskENTER_CRITICAL();
+	for(i = 0; i < TELEMETRY_NUM_SIGNALS; i++)
+	{
+		signals[i].decimation = 0;
+	}
+	taskEXIT_CRITICAL();
+ }
+
+ static uint8_t get_type_size(TELEMETRY_TYPE type)
+ {
+	return (type == TELEMETRY_U16) ? 2 : 4;
+ }
+
+ static void flush_batch(void)
+ {
+	if(telemetry_batch_length > 0)
+	{
+		usb_send_frame(USB_FRAME_TELEMETRY, telemetry_batch_start_ms, telemetry_batch, telemetry_batch_length);
+		telemetry_batch_length = 0;
+	}
+ }
+
+ /*
+ *	\brief Samples subscribed signals that are due and adds them to the current batch
+ *
+ *	Each record is the time offset from the batch timestamp, a mask of the signals
+ *	present, then the values of those signals in signal order. The batch is sent once
+ *	the next record might not fit or it is stale.
+ */
+ void telemetry_sample(void)
+ {
+	uint8_t record[TELEMETRY_RECORD_HEADER_SIZE + (4 * TELEMETRY_NUM_SIGNALS)];
+	uint16_t record_length = TELEMETRY_RECORD_HEADER_SIZE;
+	uint32_t mask = 0;
+	uint8_t i;
+
+	uint32_t current_time_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	if(telemetry_batch_length == 0)
+	{
+		telemetry_batch_start_ms = current_time_ms;
+	}
+
+	for(i = 0; i < TELEMETRY_NUM_SIGNALS; i++)
+	{
+		telemetry_signal_t * sig = &signals[i];
+		if(sig->decimation == 0 || sig->source == NULL)
+		{
+			continue;
+		}
+
+		if(++sig->count < sig->decimation)
+		{
+			continue;
+		}
+		sig->count = 0;
+
+		// Sources are aligned and no wider than a word, so each read is atomic
+		if(sig->type == TELEMETRY_U16)
+		{
+			uint16_t value = *(volatile uint16_t *) sig->source;
+			memcpy(&record[record_length], &value, 2);
+		}
+		else
+		{
+			uint32_t value = *(volatile uint32_t *) sig->source;
+			memcpy(&record[record_length], &value, 4);
+		}
+		record_length += get_type_size(sig->type);
+		mask |= (1UL << i);
+	}
+
+	if(mask != 0)
+	{
+		if(telemetry_batch_length + record_length > USB_FRAME_MAX_PAYLOAD_SIZE)
+		{
+			flush_batch();
+			telemetry_batch_start_ms = current_time_ms;
+		}
+
+		uint16_t time_offset_ms = (uint16_t) (current_time_ms - telemetry_batch_start_ms);
+		memcpy(&record[0], &time_offset_ms, 2);
+		memcpy(&record[2], &mask, 4);
+		memcpy(&telemetry_batch[telemetry_batch_length], record, record_length);
+		telemetry_batch_length += record_length;
+	}
+
+	if(telemetry_batch_length > 0 &&
+		(current_time_ms - telemetry_batch_start_ms) >= TELEMETRY_FRAME_MAX_AGE_MS)
+	{
+		flush_batch();
+	}
+ }
\ No newline at end of file
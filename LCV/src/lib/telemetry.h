@@ -0,0 +1,85 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file telemetry.h
+ *
+ * \brief Telemetry signal registry and subscription packer
+ *
+ */
+
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#define TELEMETRY_RECORD_HEADER_SIZE	(6)		// time offset ms, presence mask
+#define TELEMETRY_FRAME_MAX_AGE_MS		(50)
+#define TELEMETRY_SUBSCRIPTION_SIZE		(3)		// signal, decimation
+
+/*
+*	\brief Enumeration of telemetry signals, the host decodes by these values
+*/
+typedef enum
+{
+	TELEMETRY_ADC_RAW_0 = 0,	// ADC scan, in scan order
+	TELEMETRY_ADC_RAW_1 = 1,
+	TELEMETRY_ADC_RAW_2 = 2,
+	TELEMETRY_ADC_RAW_3 = 3,
+	TELEMETRY_ADC_RAW_4 = 4,
+	TELEMETRY_ADC_RAW_5 = 5,
+	TELEMETRY_ADC_RAW_6 = 6,
+	TELEMETRY_ADC_RAW_7 = 7,
+	TELEMETRY_ADC_RAW_8 = 8,
+	TELEMETRY_PRESSURE_VOTED = 9,
+	TELEMETRY_PRESSURE_SET_POINT = 10,
+	TELEMETRY_FLOW = 11,
+	TELEMETRY_TIDAL_VOLUME = 12,
+	TELEMETRY_MOTOR_COMMAND = 13,
+	TELEMETRY_DAC_CODE = 14,
+	TELEMETRY_ALARMS = 15,
+	TELEMETRY_CONTROL_TIME_US = 16,
+	TELEMETRY_MOTOR_RPM = 17,
+	TELEMETRY_MOTOR_TEMP = 18,
+	TELEMETRY_MOTOR_TEMP_PREDICTED = 19,
+	TELEMETRY_COMPLIANCE = 20,
+	TELEMETRY_RESISTANCE = 21,
+	TELEMETRY_LEAK = 22,
+	TELEMETRY_NUM_SIGNALS = 23	// At most 32, the presence mask is one word
+} TELEMETRY_SIGNAL;
+
+/*
+*	\brief Enumeration of signal storage types
+*/
+typedef enum
+{
+	TELEMETRY_U16 = 0,
+	TELEMETRY_I32 = 1,
+	TELEMETRY_U32 = 2,
+	TELEMETRY_FLOAT = 3
+} TELEMETRY_TYPE;
+
+bool telemetry_register(TELEMETRY_SIGNAL signal, TELEMETRY_TYPE type, volatile void * source);
+bool telemetry_subscribe(TELEMETRY_SIGNAL signal, uint16_t decimation);
+void telemetry_unsubscribe_all(void);
+void telemetry_sample(void);
+
+#endif /* TELEMETRY_H_ */
\ No newline at end of file
@@ -0,0 +1,83 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file timebase.c
+ *
+ * \brief Free running microsecond counter
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "timebase.h"
+
+ static bool setup = false;
+
+ /*
+ *	\brief Starts a 32 bit TC counting at 1 MHz from the 8 MHz GCLK
+ *
+ *	Also used as the FreeRTOS run time stats counter, so it is started by the scheduler.
+ */
+ void timebase_init(void)
+ {
+	if(setup)
+	{
+		return;
+	}
+
+	struct system_gclk_chan_config gclk_config;
+	system_gclk_chan_get_config_defaults(&gclk_config);
+	gclk_config.source_generator = GCLK_GENERATOR_1;	// 8 MHz
+	system_gclk_chan_set_config(TIMEBASE_TC_GCLK_ID, &gclk_config);
+	system_gclk_chan_enable(TIMEBASE_TC_GCLK_ID);
+
+	system_apb_clock_set_mask(SYSTEM_CLOCK_APB_APBC, PM_APBCMASK_TC4 | PM_APBCMASK_TC5);
+
+	TIMEBASE_TC->COUNT32.CTRLA.reg = TC_CTRLA_SWRST;
+	while(TIMEBASE_TC->COUNT32.CTRLA.reg & TC_CTRLA_SWRST);
+
+	TIMEBASE_TC->COUNT32.CTRLA.reg = TC_CTRLA_MODE_COUNT32 | TC_CTRLA_PRESCALER_DIV8;
+	while(TIMEBASE_TC->COUNT32.STATUS.reg & TC_STATUS_SYNCBUSY);
+
+	// Keep COUNT synchronized so reads do not have to wait
+	TIMEBASE_TC->COUNT32.READREQ.reg = TC_READREQ_RCONT | TC_READREQ_ADDR(TIMEBASE_COUNT_OFFSET);
+
+	TIMEBASE_TC->COUNT32.CTRLA.reg |= TC_CTRLA_ENABLE;
+	while(TIMEBASE_TC->COUNT32.STATUS.reg & TC_STATUS_SYNCBUSY);
+
+	setup = true;
+ }
+
+ /*
+ *	\brief Gets the free running time, safe from any context
+ *
+ *	\return The time since start in microseconds, wraps after about 71 minutes
+ */
+ uint32_t get_time_us(void)
+ {
+	if(!setup)
+	{
+		return 0;
+	}
+	return TIMEBASE_TC->COUNT32.COUNT.reg;
+ }
\ No newline at end of file
@@ -0,0 +1,42 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file timebase.h
+ *
+ * \brief Free running microsecond counter
+ *
+ *	Included by FreeRTOSConfig.h for the run time stats counter, so only depends on standard types.
+ */
+
+
+#ifndef TIMEBASE_H_
+#define TIMEBASE_H_
+
+#define TIMEBASE_TC				TC4		// TC5 is taken as the upper half in 32 bit mode
+#define TIMEBASE_TC_GCLK_ID		TC4_GCLK_ID
+#define TIMEBASE_COUNT_OFFSET	(0x10)	// COUNT register, for read synchronization
+
+void timebase_init(void);
+uint32_t get_time_us(void);
+
+#endif /* TIMEBASE_H_ */
\ No newline at end of file
@@ -0,0 +1,181 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file trace.c
+ *
+ * \brief RAM ring recorder for FreeRTOS trace hooks
+ *
+ */
+
+ #include "../task_monitor.h"
+
+ #include "timebase.h"
+ #include "usb_interface.h"
+
+ #include "trace.h"
+
+ typedef struct
+ {
+	uint32_t time_us;
+	uint8_t event;
+	uint8_t reserved;
+	uint16_t object;
+ } trace_event_t;
+
+ static trace_event_t trace_ring[TRACE_RING_EVENTS];
+ static volatile uint32_t trace_head = 0;	// Total events recorded since start
+ static volatile bool trace_running = false;
+
+ static uint8_t dump_buffer[USB_FRAME_MAX_PAYLOAD_SIZE];
+
+ /*
+ *	\brief Records an event, safe from any context including the kernel hooks
+ *
+ *	\param event The event
+ *	\param object The object ID, see TRACE_OBJECT_ID
+ */
+ void trace_record(TRACE_EVENT event, uint16_t object)
+ {
+	if(!trace_running)
+	{
+		return;
+	}
+
+	UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+	trace_event_t * entry = &trace_ring[trace_head % TRACE_RING_EVENTS];
+	entry->time_us = get_time_us();
+	entry->event = (uint8_t) event;
+	entry->reserved = 0;
+	entry->object = object;
+	trace_head++;
+	portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+ }
+
+ /*
+ *	\brief Clears the ring and starts recording, older events are overwritten once full
+ */
+ void trace_start(void)
+ {
+	taskENTER_CRITICAL();
+	trace_head = 0;
+	trace_running = true;
+	taskEXIT_CRITICAL();
+ }
+
+ void trace_stop(void)
+ {
+	trace_running = false;
+ }
+
+ static void send_dump_frame(uint16_t length)
+ {
+	uint8_t attempts;
+	for(attempts = 0; attempts < TRACE_DUMP_RETRIES; attempts++)
+	{
+		if(usb_wait_tx_space(length, pdMS_TO_TICKS(10)) &&
+			usb_send_frame(USB_FRAME_TRACE, xTaskGetTickCount() * portTICK_PERIOD_MS, dump_buffer, length))
+		{
+			return;
+		}
+	}
+ }
+
+ static void dump_task_names(uint32_t first, uint32_t count)
+ {
+	uint16_t tasks[TRACE_DUMP_MAX_TASKS];
+	uint8_t num_tasks = 0;
+	uint32_t i;
+	uint8_t j;
+
+	for(i = first; i < first + count; i++)
+	{
+		trace_event_t * entry = &trace_ring[i % TRACE_RING_EVENTS];
+		if(entry->event != TRACE_TASK_SWITCHED_IN && entry->event != TRACE_TASK_NOTIFY &&
+			entry->event != TRACE_TASK_NOTIFY_FROM_ISR)
+		{
+			continue;
+		}
+		for(j = 0; j < num_tasks && tasks[j] != entry->object; j++);
+		if(j == num_tasks && num_tasks < TRACE_DUMP_MAX_TASKS)
+		{
+			tasks[num_tasks++] = entry->object;
+		}
+	}
+
+	uint16_t length = 1;
+	dump_buffer[0] = TRACE_DUMP_TASKS;
+	for(j = 0; j < num_tasks; j++)
+	{
+		// Tasks are never deleted, so the handle rebuilt from its RAM address is still valid
+		TaskHandle_t task = (TaskHandle_t) (HMCRAMC0_ADDR | tasks[j]);
+		memcpy(&dump_buffer[length], &tasks[j], 2);
+		memset(&dump_buffer[length+2], 0, configMAX_TASK_NAME_LEN);
+		strncpy((char *) &dump_buffer[length+2], pcTaskGetName(task), configMAX_TASK_NAME_LEN);
+		length += TRACE_DUMP_TASK_ENTRY_SIZE;
+	}
+	send_dump_frame(length);
+ }
+
+ /*
+ *	\brief Stops recording and sends the ring, oldest event first
+ *
+ *	Sends the names of the tasks seen, the events, then an end record holding the number
+ *	of events sent and the number overwritten.
+ */
+ void trace_dump(void)
+ {
+	trace_stop();
+
+	uint32_t head = trace_head;
+	uint32_t count = (head > TRACE_RING_EVENTS) ? TRACE_RING_EVENTS : head;
+	uint32_t first = head - count;
+	uint32_t overwritten = first;
+	uint32_t i;
+
+	dump_task_names(first, count);
+
+	for(i = 0; i < count; i += TRACE_DUMP_EVENTS_PER_FRAME)
+	{
+		uint32_t events = count - i;
+		if(events > TRACE_DUMP_EVENTS_PER_FRAME)
+		{
+			events = TRACE_DUMP_EVENTS_PER_FRAME;
+		}
+
+		dump_buffer[0] = TRACE_DUMP_EVENTS;
+		memcpy(&dump_buffer[1], &i, 4);
+		uint16_t length = TRACE_DUMP_HEADER_SIZE;
+		uint32_t j;
+		for(j = 0; j < events; j++)
+		{
+			memcpy(&dump_buffer[length], &trace_ring[(first + i + j) % TRACE_RING_EVENTS], TRACE_EVENT_SIZE);
+			length += TRACE_EVENT_SIZE;
+		}
+		send_dump_frame(length);
+	}
+
+	dump_buffer[0] = TRACE_DUMP_END;
+	memcpy(&dump_buffer[1], &count, 4);
+	memcpy(&dump_buffer[5], &overwritten, 4);
+	send_dump_frame(9);
+ }
\ No newline at end of file
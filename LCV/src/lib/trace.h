@@ -0,0 +1,99 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file trace.h
+ *
+ * \brief RAM ring recorder for FreeRTOS trace hooks
+ *
+ *	Included by FreeRTOSConfig.h, so only depends on standard types.
+ */
+
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#define TRACE_RING_EVENTS			(128)
+#define TRACE_EVENT_SIZE			(8)		// time us, event, reserved, object
+#define TRACE_DUMP_HEADER_SIZE		(5)		// dump record, first event index
+#define TRACE_DUMP_EVENTS_PER_FRAME	(29)
+#define TRACE_DUMP_TASK_ENTRY_SIZE	(2 + configMAX_TASK_NAME_LEN)	// object, name
+#define TRACE_DUMP_MAX_TASKS		(16)
+#define TRACE_DUMP_RETRIES			(20)
+
+// Objects are recorded as the low half of their RAM address
+#define TRACE_OBJECT_ID(object)		((uint16_t) (uint32_t) (object))
+
+/*
+*	\brief Enumeration of recorded events
+*
+*	Switching out is implied by the next switch in, so only switch ins are recorded.
+*/
+typedef enum
+{
+	TRACE_TASK_SWITCHED_IN = 0,		// Object is the task
+	TRACE_QUEUE_SEND = 1,			// Object is the queue, semaphore or mutex
+	TRACE_QUEUE_RECEIVE = 2,
+	TRACE_QUEUE_SEND_FROM_ISR = 3,
+	TRACE_QUEUE_RECEIVE_FROM_ISR = 4,
+	TRACE_BLOCKING_ON_QUEUE_SEND = 5,
+	TRACE_BLOCKING_ON_QUEUE_RECEIVE = 6,
+	TRACE_TASK_NOTIFY = 7,			// Object is the task notified
+	TRACE_TASK_NOTIFY_FROM_ISR = 8,
+	TRACE_ISR_ENTER = 9				// Object is a TRACE_ISR value
+} TRACE_EVENT;
+
+/*
+*	\brief Enumeration of instrumented interrupts
+*/
+typedef enum
+{
+	TRACE_ISR_ADC = 0,
+	TRACE_ISR_USB_RX = 1
+} TRACE_ISR;
+
+/*
+*	\brief Enumeration of dump records, first byte of each trace frame
+*/
+typedef enum
+{
+	TRACE_DUMP_TASKS = 0,
+	TRACE_DUMP_EVENTS = 1,
+	TRACE_DUMP_END = 2
+} TRACE_DUMP_RECORD;
+
+/*
+*	\brief Enumeration of trace command actions
+*/
+typedef enum
+{
+	TRACE_COMMAND_STOP = 0,
+	TRACE_COMMAND_START = 1,
+	TRACE_COMMAND_DUMP = 2
+} TRACE_COMMAND;
+
+void trace_record(TRACE_EVENT event, uint16_t object);
+void trace_start(void);
+void trace_stop(void);
+void trace_dump(void);
+
+#endif /* TRACE_H_ */
\ No newline at end of file
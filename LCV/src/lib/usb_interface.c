@@ -28,40 +28,252 @@ SOFTWARE.*/
  */ 
 
  #include "../task_monitor.h"
- #include "../task_control.h"
+
+ #include "checksum.h"
+ #include "trace.h"
 
  #include "usb_interface.h"
 
  static volatile bool authorize_cdc_transfer = false;
 
+ static SemaphoreHandle_t tx_mutex = NULL;
+ static StreamBufferHandle_t rx_stream = NULL;
+ static volatile uint32_t rx_overflow_count = 0;
+ static volatile uint32_t rx_error_count = 0;
+
+ static StaticSemaphore_t tx_mutex_buffer;
+ static StaticStreamBuffer_t rx_stream_buffer;
+ static uint8_t rx_stream_storage[USB_RX_STREAM_SIZE + 1];	// Stream buffers need one spare byte
+
+ static uint8_t frame_buffer[USB_FRAME_HEADER_SIZE + USB_FRAME_MAX_PAYLOAD_SIZE + USB_FRAME_CRC_SIZE];
+ static uint16_t frame_sequence = 0;
+ static volatile uint32_t dropped_frame_count = 0;
+
  void usb_interface_init(void)
  {
+	// Telemetry and command responses come from different tasks
+	tx_mutex = xSemaphoreCreateMutexStatic(&tx_mutex_buffer);
+	rx_stream = xStreamBufferCreateStatic(USB_RX_STREAM_SIZE, 1, rx_stream_storage, &rx_stream_buffer);
+
 	udc_start();
  }
 
- void usb_transmit_control(lcv_control_t * control_params, float output)
+ /*
+ *	\brief Frames and sends a payload over CDC
+ *
+ *	Never blocks. If the CDC buffer cannot take the whole frame it is dropped, but the
+ *	sequence number still advances so the host can detect the gap.
+ *
+ *	\param type The frame type
+ *	\param timestamp_ms The device time the payload refers to
+ *	\param payload Pointer to the payload
+ *	\param length The payload length in bytes
+ *
+ *	\return True if the frame was handed to the CDC driver
+ */
+ bool usb_send_frame(USB_FRAME_TYPE type, uint32_t timestamp_ms, uint8_t * payload, uint16_t length)
+ {
+	if(!authorize_cdc_transfer || length > USB_FRAME_MAX_PAYLOAD_SIZE)
+	{
+		return false;
+	}
+
+	if(xSemaphoreTake(tx_mutex, pdMS_TO_TICKS(USB_TX_LOCK_TIMEOUT_MS)) != pdTRUE)
+	{
+		dropped_frame_count++;
+		return false;
+	}
+
+	uint16_t sequence = frame_sequence++;
+
+	frame_buffer[0] = USB_MAGIC_BYTE;
+	frame_buffer[1] = (uint8_t) type;
+	memcpy(&frame_buffer[2], &length, 2);
+	memcpy(&frame_buffer[4], &sequence, 2);
+	memcpy(&frame_buffer[6], &timestamp_ms, 4);
+	memcpy(&frame_buffer[USB_FRAME_HEADER_SIZE], payload, length);
+
+	uint16_t crc = crc_ccitt_ffff(&frame_buffer[1], USB_FRAME_HEADER_SIZE - 1 + length); // Ignore magic
+	memcpy(&frame_buffer[USB_FRAME_HEADER_SIZE + length], &crc, USB_FRAME_CRC_SIZE);
+
+	bool sent = false;
+	uint16_t frame_length = USB_FRAME_HEADER_SIZE + length + USB_FRAME_CRC_SIZE;
+	if(udi_cdc_is_tx_ready() && udi_cdc_get_free_tx_buffer() >= frame_length)
+	{
+		udi_cdc_write_buf(frame_buffer, frame_length);
+		sent = true;
+	}
+	else
+	{
+		dropped_frame_count++;
+	}
+
+	xSemaphoreGive(tx_mutex);
+	return sent;
+ }
+
+ /*
+ *	\brief Waits until the CDC buffer could take a whole frame, for bulk transfers
+ *
+ *	Another task may still fill the space first, so the send can fail anyway.
+ *
+ *	\param length The payload length in bytes
+ *	\param ticks_to_wait The maximum time to wait
+ *
+ *	\return True if there was space
+ */
+ bool usb_wait_tx_space(uint16_t length, TickType_t ticks_to_wait)
+ {
+	TickType_t start_ticks = xTaskGetTickCount();
+	uint16_t frame_length = USB_FRAME_HEADER_SIZE + length + USB_FRAME_CRC_SIZE;
+
+	while(!(udi_cdc_is_tx_ready() && udi_cdc_get_free_tx_buffer() >= frame_length))
+	{
+		if(!authorize_cdc_transfer || (xTaskGetTickCount() - start_ticks) >= ticks_to_wait)
+		{
+			return false;
+		}
+		vTaskDelay(1);
+	}
+	return authorize_cdc_transfer;
+ }
+
+ /*
+ *	\brief Gets the number of frames dropped because the CDC buffer was full
+ *
+ *	\return The dropped frame count
+ */
+ uint32_t usb_get_dropped_frame_count(void)
+ {
+	return dropped_frame_count;
+ }
+
+ /*
+ *	\brief Receives bytes sent by the host
+ *
+ *	\param buff Pointer to the buffer to fill
+ *	\param length The maximum number of bytes to receive
+ *	\param ticks_to_wait The maximum time to block waiting for data
+ *
+ *	\return The number of bytes received
+ */
+ size_t usb_receive(uint8_t * buff, size_t length, TickType_t ticks_to_wait)
+ {
+	return xStreamBufferReceive(rx_stream, buff, length, ticks_to_wait);
+ }
+
+ /*
+ *	\brief Runs the frame decoder on one received byte
+ *
+ *	Frames from the host use the same layout as frames to the host. Bytes are discarded
+ *	until a magic byte is found, and a frame with a bad length or CRC restarts the search.
+ *
+ *	\param byte The received byte
+ *	\param frame Pointer to the frame to fill once complete
+ *
+ *	\return True if a complete, valid frame was decoded into frame
+ */
+ bool usb_parse_byte(uint8_t byte, usb_frame_t * frame)
  {
-	int32_t i;
-	if(authorize_cdc_transfer)
+	static uint8_t rx_frame_buffer[USB_FRAME_HEADER_SIZE + USB_RX_MAX_PAYLOAD_SIZE + USB_FRAME_CRC_SIZE];
+	static uint16_t index = 0;
+	static uint16_t length = 0;
+
+	if(index == 0 && byte != USB_MAGIC_BYTE)
+	{
+		return false;
+	}
+
+	rx_frame_buffer[index++] = byte;
+
+	if(index == USB_FRAME_HEADER_SIZE)
 	{
-		// send it
-		uint8_t buffer[14];
-		buffer[0] = USB_MAGIC_BYTE;
-		memcpy(&buffer[1], &control_params->pressure_current_cm_h20, 4);
-		memcpy(&buffer[5], &control_params->pressure_set_point_cm_h20, 4);
-		memcpy(&buffer[9], &output, 4);
-		buffer[13] = 0;
-		for(i = 1; i < 13; i++)
+		memcpy(&length, &rx_frame_buffer[2], 2);
+		if(length > USB_RX_MAX_PAYLOAD_SIZE)
 		{
-			buffer[13] += buffer[i];
+			rx_error_count++;
+			index = 0;
 		}
+		return false;
+	}
+
+	if(index < USB_FRAME_HEADER_SIZE || index < (USB_FRAME_HEADER_SIZE + length + USB_FRAME_CRC_SIZE))
+	{
+		return false;
+	}
+
+	// Full frame
+	index = 0;
+
+	uint16_t crc_read;
+	memcpy(&crc_read, &rx_frame_buffer[USB_FRAME_HEADER_SIZE + length], USB_FRAME_CRC_SIZE);
+	uint16_t crc_calc = crc_ccitt_ffff(&rx_frame_buffer[1], USB_FRAME_HEADER_SIZE - 1 + length); // Ignore magic
+	if(crc_calc != crc_read)
+	{
+		rx_error_count++;
+		return false;
+	}
+
+	frame->type = rx_frame_buffer[1];
+	frame->length = length;
+	memcpy(&frame->sequence, &rx_frame_buffer[4], 2);
+	memcpy(&frame->timestamp_ms, &rx_frame_buffer[6], 4);
+	memcpy(frame->payload, &rx_frame_buffer[USB_FRAME_HEADER_SIZE], length);
+	return true;
+ }
+
+ /*
+ *	\brief Gets the number of received bytes lost because the RX stream was full
+ *
+ *	\return The overflow count in bytes
+ */
+ uint32_t usb_get_rx_overflow_count(void)
+ {
+	return rx_overflow_count;
+ }
+
+ /*
+ *	\brief Gets the number of received frames rejected for bad length or CRC
+ *
+ *	\return The error count
+ */
+ uint32_t usb_get_rx_error_count(void)
+ {
+	return rx_error_count;
+ }
+
+ void my_callback_rx_notify(uint8_t port)
+ {
+	// WARNING: ISR context
+	static bool in_rx_notify = false;
+	BaseType_t higher_priority_task_woken = pdFALSE;
+	uint8_t buff[16];
+	iram_size_t available;
+
+	UNUSED(port);
+	trace_record(TRACE_ISR_ENTER, TRACE_ISR_USB_RX);
+
+	// Reading can restart the CDC transfer and re-enter here, so let the outer call drain in order
+	if(in_rx_notify)
+	{
+		return;
+	}
+	in_rx_notify = true;
 
-		
-		if(udi_cdc_is_tx_ready() && udi_cdc_get_free_tx_buffer() >= 14)
+	while((available = udi_cdc_get_nb_received_data()) > 0)
+	{
+		if(available > sizeof(buff))
 		{
-			udi_cdc_write_buf(buffer, 14);
+			available = sizeof(buff);
 		}
+		udi_cdc_read_no_polling(buff, available);
+
+		size_t stored = xStreamBufferSendFromISR(rx_stream, buff, available, &higher_priority_task_woken);
+		rx_overflow_count += (available - stored);
 	}
+
+	in_rx_notify = false;
+	portYIELD_FROM_ISR(higher_priority_task_woken);
  }
 
  bool my_callback_cdc_enable(void)
@@ -31,11 +31,74 @@ SOFTWARE.*/
 #ifndef USB_INTERFACE_H_
 #define USB_INTERFACE_H_
 
-#include "../task_control.h"
-
 #define USB_MAGIC_BYTE		(0x5E)
 
+/*
+*	Frame layout, all multi-byte fields little endian:
+*	[0] magic, [1] type, [2:3] payload length, [4:5] sequence, [6:9] timestamp ms,
+*	[10:10+length] payload, then CRC16-CCITT (0xFFFF start) over bytes 1 through end of payload
+*/
+#define USB_FRAME_HEADER_SIZE			(10)
+#define USB_FRAME_CRC_SIZE				(2)
+#define USB_FRAME_MAX_PAYLOAD_SIZE		(240) // Whole frame must fit in the CDC TX buffer
+
+#define USB_RX_STREAM_SIZE				(256)
+#define USB_RX_MAX_PAYLOAD_SIZE			(64)
+#define USB_TX_LOCK_TIMEOUT_MS			(2)
+
+/*
+*	\brief Enumeration of frame types
+*/
+typedef enum
+{
+	USB_FRAME_RESPONSE = 0x02,
+	USB_FRAME_TELEMETRY = 0x03,
+	USB_FRAME_ADC_STREAM = 0x04,
+	USB_FRAME_TASK_STATS = 0x05,
+	USB_FRAME_TRACE = 0x06,
+	// Host to device commands, answered with a USB_FRAME_RESPONSE
+	USB_COMMAND_GET_SETTINGS = 0x40,
+	USB_COMMAND_SET_SETTINGS = 0x41,
+	USB_COMMAND_GET_GAINS = 0x42,
+	USB_COMMAND_SET_GAINS = 0x43,
+	USB_COMMAND_READ_FRAM = 0x44,
+	USB_COMMAND_GET_STATS = 0x45,
+	USB_COMMAND_SUBSCRIBE = 0x46,
+	USB_COMMAND_ADC_STREAM = 0x47,
+	USB_COMMAND_GET_LATENCY = 0x48,
+	USB_COMMAND_TRACE = 0x49,
+	USB_COMMAND_GET_SCHEDULE = 0x4A,
+	USB_COMMAND_SET_SCHEDULE = 0x4B
+} USB_FRAME_TYPE;
+
+/*
+*	\brief Enumeration of command response status codes
+*/
+typedef enum
+{
+	USB_STATUS_OK = 0,
+	USB_STATUS_BAD_LENGTH = 1,
+	USB_STATUS_INVALID = 2,
+	USB_STATUS_UNKNOWN_COMMAND = 3,
+	USB_STATUS_BUSY = 4
+} USB_RESPONSE_STATUS;
+
+typedef struct
+{
+	uint8_t type;
+	uint16_t length;
+	uint16_t sequence;
+	uint32_t timestamp_ms;
+	uint8_t payload[USB_RX_MAX_PAYLOAD_SIZE];
+} usb_frame_t;
+
 void usb_interface_init(void);
-void usb_transmit_control(lcv_control_t * control_params, float output);
+bool usb_send_frame(USB_FRAME_TYPE type, uint32_t timestamp_ms, uint8_t * payload, uint16_t length);
+bool usb_wait_tx_space(uint16_t length, TickType_t ticks_to_wait);
+uint32_t usb_get_dropped_frame_count(void);
+size_t usb_receive(uint8_t * buff, size_t length, TickType_t ticks_to_wait);
+bool usb_parse_byte(uint8_t byte, usb_frame_t * frame);
+uint32_t usb_get_rx_overflow_count(void);
+uint32_t usb_get_rx_error_count(void);
 
 #endif /* USB_INTERFACE_H_ */
\ No newline at end of file
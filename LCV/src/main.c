@@ -31,6 +31,8 @@ SOFTWARE.*/
 #include <asf.h>
 #include "task_monitor.h"
 
+#include "lib/heartbeat.h"
+#include "lib/motor_speed.h"
 #include "lib/usb_interface.h"
 
 static void configure_wdt(void)
@@ -51,8 +53,9 @@ int main (void)
 	irq_initialize_vectors();
 	cpu_irq_enable();
 	
-	// Enable WDT
+	// Enable WDT, fed by the heartbeat supervisor in the monitor task
 	configure_wdt();
+	heartbeat_init();
 
 	// Chirp to show reboot
 	ioport_set_pin_level(BUZZER_GPIO, BUZZER_GPIO_ACTIVE_LEVEL);
@@ -67,6 +70,7 @@ int main (void)
 	create_control_task(taskCONTROL_TASK_STACK_SIZE, taskCONTROL_TASK_PRIORITY);
 	create_sensor_task(taskSENSOR_TASK_STACK_SIZE, taskSENSOR_TASK_PRIORITY);
 	create_hmi_task(taskHMI_TASK_STACK_SIZE, taskHMI_TASK_PRIORITY);
+	create_command_task(taskCOMMAND_TASK_STACK_SIZE, taskCOMMAND_TASK_PRIORITY);
 
 	vTaskStartScheduler();
 	
@@ -80,15 +84,30 @@ int main (void)
 
 /******* FreeRTOS User-Defined Hooks *******/
 
-void vApplicationMallocFailedHook(void);
+void vApplicationGetIdleTaskMemory(StaticTask_t ** ppxIdleTaskTCBBuffer, StackType_t ** ppxIdleTaskStackBuffer, uint32_t * pulIdleTaskStackSize);
 
-void vApplicationMallocFailedHook(void)
+void vApplicationGetIdleTaskMemory(StaticTask_t ** ppxIdleTaskTCBBuffer, StackType_t ** ppxIdleTaskStackBuffer, uint32_t * pulIdleTaskStackSize)
 {
-	/* Only called if configUSE_MALLOC_FAILED_HOOK is set to 1 in FreeRTOSConfig.h */
-	taskDISABLE_INTERRUPTS();
-	for (;;)
-	{
-	}
+	/* Called by the scheduler since configSUPPORT_STATIC_ALLOCATION is set to 1 in FreeRTOSConfig.h */
+	static StaticTask_t idle_task_buffer;
+	static StackType_t idle_task_stack[configMINIMAL_STACK_SIZE];
+
+	*ppxIdleTaskTCBBuffer = &idle_task_buffer;
+	*ppxIdleTaskStackBuffer = idle_task_stack;
+	*pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+void vApplicationGetTimerTaskMemory(StaticTask_t ** ppxTimerTaskTCBBuffer, StackType_t ** ppxTimerTaskStackBuffer, uint32_t * pulTimerTaskStackSize);
+
+void vApplicationGetTimerTaskMemory(StaticTask_t ** ppxTimerTaskTCBBuffer, StackType_t ** ppxTimerTaskStackBuffer, uint32_t * pulTimerTaskStackSize)
+{
+	/* Called by the timer service since configSUPPORT_STATIC_ALLOCATION is set to 1 in FreeRTOSConfig.h */
+	static StaticTask_t timer_task_buffer;
+	static StackType_t timer_task_stack[configTIMER_TASK_STACK_DEPTH];
+
+	*ppxTimerTaskTCBBuffer = &timer_task_buffer;
+	*ppxTimerTaskStackBuffer = timer_task_stack;
+	*pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
 }
 
 void vApplicationIdleHook(void);
@@ -104,6 +123,9 @@ void vApplicationTickHook(void)
 {
 	/* This function will be called by each tick interrupt if
 	configUSE_TICK_HOOK is set to 1 in FreeRTOSConfig.h */
+
+	// 1 kHz inner speed loop, does nothing unless started by the control task
+	motor_speed_loop_tick();
 }
 
 void vApplicationStackOverflowHook(void);
@@ -0,0 +1,477 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file task_command.c
+ *
+ * \brief Host command handling task
+ *
+ */
+
+#include <math.h>
+
+#include "task_monitor.h"
+#include "task_control.h"
+#include "task_hmi.h"
+
+#include "lib/adc_interface.h"
+#include "lib/adc_stream.h"
+#include "lib/alarm_monitoring.h"
+#include "lib/controller.h"
+#include "lib/fm25l16b.h"
+#include "lib/gain_schedule.h"
+#include "lib/heartbeat.h"
+#include "lib/latency.h"
+#include "lib/telemetry.h"
+#include "lib/trace.h"
+#include "lib/usb_interface.h"
+
+#include "task_command.h"
+
+// Task handle
+static TaskHandle_t command_task_handle = NULL;
+static StaticTask_t command_task_buffer;
+static StackType_t command_task_stack[taskCOMMAND_TASK_STACK_SIZE];
+
+static SemaphoreHandle_t fram_read_done = NULL;
+static StaticSemaphore_t fram_read_done_buffer;
+static uint8_t fram_read_buffer[FRAM_MAX_READ_SIZE];
+
+static uint8_t response[USB_FRAME_MAX_PAYLOAD_SIZE];
+static uint32_t commands_handled = 0;
+
+/*
+*	\brief SPI callback for FRAM reads requested by the host
+*
+*	\param buff The SPI receive buffer, including the read header
+*	\param length The length of the buffer
+*/
+static void fram_read_cb(uint8_t * buff, uint32_t length)
+{
+	// WARNING: ISR context
+	BaseType_t higher_priority_task_woken = pdFALSE;
+
+	if(length > FRAM_READ_HEADER_SIZE)
+	{
+		memcpy(fram_read_buffer, buff + FRAM_READ_HEADER_SIZE, length - FRAM_READ_HEADER_SIZE);
+	}
+	xSemaphoreGiveFromISR(fram_read_done, &higher_priority_task_woken);
+	portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static void send_response(uint8_t command, USB_RESPONSE_STATUS status, uint16_t data_length)
+{
+	response[0] = command;
+	response[1] = (uint8_t) status;
+	usb_send_frame(USB_FRAME_RESPONSE, xTaskGetTickCount() * portTICK_PERIOD_MS,
+		response, COMMAND_RESPONSE_HEADER_SIZE + data_length);
+}
+
+static void pack_settings(lcv_parameters_t * params, uint8_t * buff)
+{
+	// Same layout as FRAM storage, after its version byte
+	buff[0] = params->enable;
+	buff[1] = params->ie_ratio_tenths;
+	memcpy(&buff[2], &params->tidal_volume_ml, 4);
+	memcpy(&buff[6], &params->peep_cm_h20, 4);
+	memcpy(&buff[10], &params->pip_cm_h20, 4);
+	memcpy(&buff[14], &params->breath_per_min, 4);
+	memcpy(&buff[18], &params->rise_time_ms, 4);
+	memcpy(&buff[22], &params->fall_time_ms, 4);
+}
+
+static void unpack_settings(uint8_t * buff, lcv_parameters_t * params)
+{
+	params->enable = buff[0];
+	params->ie_ratio_tenths = buff[1];
+	memcpy(&params->tidal_volume_ml, &buff[2], 4);
+	memcpy(&params->peep_cm_h20, &buff[6], 4);
+	memcpy(&params->pip_cm_h20, &buff[10], 4);
+	memcpy(&params->breath_per_min, &buff[14], 4);
+	memcpy(&params->rise_time_ms, &buff[18], 4);
+	memcpy(&params->fall_time_ms, &buff[22], 4);
+}
+
+static void pack_gains(controller_param_t * params, uint8_t * buff)
+{
+	memcpy(&buff[0], &params->kf, 4);
+	memcpy(&buff[4], &params->kp, 4);
+	memcpy(&buff[8], &params->ki, 4);
+	memcpy(&buff[12], &params->kd, 4);
+	memcpy(&buff[16], &params->integral_antiwindup, 4);
+	memcpy(&buff[20], &params->integral_enable_error_range, 4);
+	memcpy(&buff[24], &params->max_output, 4);
+	memcpy(&buff[28], &params->min_output, 4);
+}
+
+static bool unpack_gains(uint8_t * buff, controller_param_t * params)
+{
+	// Start from the gains in use so fields not carried in the payload are kept
+	*params = get_controller_params();
+	memcpy(&params->kf, &buff[0], 4);
+	memcpy(&params->kp, &buff[4], 4);
+	memcpy(&params->ki, &buff[8], 4);
+	memcpy(&params->kd, &buff[12], 4);
+	memcpy(&params->integral_antiwindup, &buff[16], 4);
+	memcpy(&params->integral_enable_error_range, &buff[20], 4);
+	memcpy(&params->max_output, &buff[24], 4);
+	memcpy(&params->min_output, &buff[28], 4);
+
+	// Output is a motor portion, so must stay within 0 to 1
+	return (isfinite(params->kf) && isfinite(params->kp) && isfinite(params->ki) && isfinite(params->kd) &&
+		isfinite(params->integral_antiwindup) && isfinite(params->integral_enable_error_range) &&
+		params->min_output >= 0.0 && params->max_output <= 1.0 && params->min_output < params->max_output);
+}
+
+/*
+*	\brief Streams a region of FRAM to the host in FRAM_MAX_READ_SIZE chunks
+*
+*	Each chunk is answered with its own response holding the chunk address then the data
+*
+*	\param frame Pointer to the command frame
+*/
+static void handle_read_fram(usb_frame_t * frame)
+{
+	uint16_t address;
+	uint16_t length;
+	memcpy(&address, &frame->payload[0], 2);
+	memcpy(&length, &frame->payload[2], 2);
+
+	if((uint32_t) address + length > FRAM_MEMORY_SIZE_BYTES)
+	{
+		send_response(frame->type, USB_STATUS_INVALID, 0);
+		return;
+	}
+
+	while(length > 0)
+	{
+		uint8_t chunk = (length > FRAM_MAX_READ_SIZE) ? FRAM_MAX_READ_SIZE : length;
+
+		// Bus is shared with settings saves, so retry briefly
+		int32_t tries = 0;
+		bool started = false;
+		xSemaphoreTake(fram_read_done, 0);
+		while(!started && tries++ < COMMAND_FRAM_RETRIES)
+		{
+			started = fram_read_asynch(address, chunk, fram_read_cb);
+			if(!started)
+			{
+				vTaskDelay(pdMS_TO_TICKS(1));
+			}
+		}
+
+		if(!started || xSemaphoreTake(fram_read_done, pdMS_TO_TICKS(COMMAND_FRAM_TIMEOUT_MS)) != pdTRUE)
+		{
+			memcpy(&response[COMMAND_RESPONSE_HEADER_SIZE], &address, 2);
+			send_response(frame->type, USB_STATUS_BUSY, 2);
+			return;
+		}
+
+		memcpy(&response[COMMAND_RESPONSE_HEADER_SIZE], &address, 2);
+		memcpy(&response[COMMAND_RESPONSE_HEADER_SIZE + 2], fram_read_buffer, chunk);
+		send_response(frame->type, USB_STATUS_OK, 2 + chunk);
+
+		address += chunk;
+		length -= chunk;
+	}
+}
+
+static void handle_get_stats(usb_frame_t * frame)
+{
+	uint32_t stats[9];
+	heartbeat_reset_record_t reset_record = heartbeat_get_reset_record();
+
+	stats[0] = xTaskGetTickCount() * portTICK_PERIOD_MS;
+	stats[1] = get_alarm_bitfield();
+	stats[2] = usb_get_dropped_frame_count();
+	stats[3] = usb_get_rx_overflow_count();
+	stats[4] = usb_get_rx_error_count();
+	stats[5] = commands_handled;
+	stats[6] = reset_record.reset_cause;
+	stats[7] = reset_record.missed_mask;
+	stats[8] = reset_record.missed_time_ms;
+
+	memcpy(&response[COMMAND_RESPONSE_HEADER_SIZE], stats, sizeof(stats));
+	send_response(frame->type, USB_STATUS_OK, sizeof(stats));
+}
+
+/*
+*	\brief Replaces the telemetry subscriptions with the requested set
+*
+*	\param frame Pointer to the command frame, holding signal and decimation pairs
+*/
+static void handle_subscribe(usb_frame_t * frame)
+{
+	uint16_t i;
+	uint16_t decimation;
+
+	if(frame->length % TELEMETRY_SUBSCRIPTION_SIZE != 0)
+	{
+		send_response(frame->type, USB_STATUS_BAD_LENGTH, 0);
+		return;
+	}
+
+	// Reject the whole set before changing anything
+	for(i = 0; i < frame->length; i += TELEMETRY_SUBSCRIPTION_SIZE)
+	{
+		if(frame->payload[i] >= TELEMETRY_NUM_SIGNALS)
+		{
+			send_response(frame->type, USB_STATUS_INVALID, 0);
+			return;
+		}
+	}
+
+	telemetry_unsubscribe_all();
+	for(i = 0; i < frame->length; i += TELEMETRY_SUBSCRIPTION_SIZE)
+	{
+		memcpy(&decimation, &frame->payload[i+1], 2);
+		telemetry_subscribe((TELEMETRY_SIGNAL) frame->payload[i], decimation);
+	}
+	send_response(frame->type, USB_STATUS_OK, 0);
+}
+
+/*
+*	\brief Sends one gain schedule entry
+*
+*	\param frame Pointer to the command frame, holding the entry index
+*/
+static void handle_get_schedule(usb_frame_t * frame)
+{
+	gain_schedule_entry_t entry;
+
+	if(frame->length != 1)
+	{
+		send_response(frame->type, USB_STATUS_BAD_LENGTH, 0);
+		return;
+	}
+	if(frame->payload[0] >= GAIN_SCHEDULE_NUM_ENTRIES)
+	{
+		send_response(frame->type, USB_STATUS_INVALID, 0);
+		return;
+	}
+
+	// Index, set flag, then the gains, which are zero if never set
+	bool valid = gain_schedule_get_entry(frame->payload[0], &entry);
+	response[COMMAND_RESPONSE_HEADER_SIZE] = frame->payload[0];
+	response[COMMAND_RESPONSE_HEADER_SIZE + 1] = valid;
+	memcpy(&response[COMMAND_RESPONSE_HEADER_SIZE + 2], &entry.kp, 4);
+	memcpy(&response[COMMAND_RESPONSE_HEADER_SIZE + 6], &entry.ki, 4);
+	memcpy(&response[COMMAND_RESPONSE_HEADER_SIZE + 10], &entry.kd, 4);
+	send_response(frame->type, USB_STATUS_OK, 2 + GAIN_SCHEDULE_ENTRY_SIZE);
+}
+
+/*
+*	\brief Replaces one gain schedule entry, saved to FRAM by the control task
+*
+*	\param frame Pointer to the command frame, holding the entry index then kp, ki and kd
+*/
+static void handle_set_schedule(usb_frame_t * frame)
+{
+	gain_schedule_entry_t entry;
+
+	if(frame->length != COMMAND_SCHEDULE_PAYLOAD_SIZE)
+	{
+		send_response(frame->type, USB_STATUS_BAD_LENGTH, 0);
+		return;
+	}
+
+	memcpy(&entry.kp, &frame->payload[1], 4);
+	memcpy(&entry.ki, &frame->payload[5], 4);
+	memcpy(&entry.kd, &frame->payload[9], 4);
+	if(!gain_schedule_set_entry(frame->payload[0], &entry))
+	{
+		send_response(frame->type, USB_STATUS_INVALID, 0);
+		return;
+	}
+	send_response(frame->type, USB_STATUS_OK, 0);
+}
+
+/*
+*	\brief Executes a command from the host and sends the response
+*
+*	\param frame Pointer to the command frame
+*/
+static void handle_command(usb_frame_t * frame)
+{
+	lcv_parameters_t settings;
+	controller_param_t gains;
+
+	commands_handled++;
+
+	switch (frame->type)
+	{
+		case USB_COMMAND_GET_SETTINGS:
+			settings = get_current_settings();
+			pack_settings(&settings, &response[COMMAND_RESPONSE_HEADER_SIZE]);
+			send_response(frame->type, USB_STATUS_OK, COMMAND_SETTINGS_PAYLOAD_SIZE);
+			break;
+
+		case USB_COMMAND_SET_SETTINGS:
+			if(frame->length != COMMAND_SETTINGS_PAYLOAD_SIZE)
+			{
+				send_response(frame->type, USB_STATUS_BAD_LENGTH, 0);
+				break;
+			}
+			unpack_settings(frame->payload, &settings);
+			if(!settings_in_range(&settings))
+			{
+				send_response(frame->type, USB_STATUS_INVALID, 0);
+				break;
+			}
+			update_settings(&settings);
+			send_response(frame->type, USB_STATUS_OK, 0);
+			break;
+
+		case USB_COMMAND_GET_GAINS:
+			gains = get_controller_params();
+			pack_gains(&gains, &response[COMMAND_RESPONSE_HEADER_SIZE]);
+			send_response(frame->type, USB_STATUS_OK, COMMAND_GAINS_PAYLOAD_SIZE);
+			break;
+
+		case USB_COMMAND_SET_GAINS:
+			if(frame->length != COMMAND_GAINS_PAYLOAD_SIZE)
+			{
+				send_response(frame->type, USB_STATUS_BAD_LENGTH, 0);
+				break;
+			}
+			if(!unpack_gains(frame->payload, &gains))
+			{
+				send_response(frame->type, USB_STATUS_INVALID, 0);
+				break;
+			}
+			update_controller_params(&gains);
+			send_response(frame->type, USB_STATUS_OK, 0);
+			break;
+
+		case USB_COMMAND_READ_FRAM:
+			if(frame->length != COMMAND_FRAM_REQUEST_SIZE)
+			{
+				send_response(frame->type, USB_STATUS_BAD_LENGTH, 0);
+				break;
+			}
+			handle_read_fram(frame);
+			break;
+
+		case USB_COMMAND_GET_STATS:
+			handle_get_stats(frame);
+			break;
+
+		case USB_COMMAND_SUBSCRIBE:
+			handle_subscribe(frame);
+			break;
+
+		case USB_COMMAND_GET_LATENCY:
+			if(frame->length != 1)
+			{
+				send_response(frame->type, USB_STATUS_BAD_LENGTH, 0);
+				break;
+			}
+			send_response(frame->type, USB_STATUS_OK, latency_pack_histograms(&response[COMMAND_RESPONSE_HEADER_SIZE]));
+			// Optionally start a new measurement window
+			if(frame->payload[0] != 0)
+			{
+				latency_reset();
+			}
+			break;
+
+		case USB_COMMAND_TRACE:
+			if(frame->length != 1 || frame->payload[0] > TRACE_COMMAND_DUMP)
+			{
+				send_response(frame->type, (frame->length != 1) ? USB_STATUS_BAD_LENGTH : USB_STATUS_INVALID, 0);
+				break;
+			}
+			send_response(frame->type, USB_STATUS_OK, 0);
+			if(frame->payload[0] == TRACE_COMMAND_START)
+			{
+				trace_start();
+			}
+			else if(frame->payload[0] == TRACE_COMMAND_STOP)
+			{
+				trace_stop();
+			}
+			else
+			{
+				trace_dump();
+			}
+			break;
+
+		case USB_COMMAND_GET_SCHEDULE:
+			handle_get_schedule(frame);
+			break;
+
+		case USB_COMMAND_SET_SCHEDULE:
+			handle_set_schedule(frame);
+			break;
+
+		case USB_COMMAND_ADC_STREAM:
+			if(frame->length != 1)
+			{
+				send_response(frame->type, USB_STATUS_BAD_LENGTH, 0);
+				break;
+			}
+			adc_stream_enable(frame->payload[0] != 0);
+			send_response(frame->type, USB_STATUS_OK, 0);
+			break;
+
+		default:
+			send_response(frame->type, USB_STATUS_UNKNOWN_COMMAND, 0);
+			break;
+	}
+}
+
+static void command_task(void * pvParameters)
+{
+	UNUSED(pvParameters);
+
+	uint8_t rx_buff[32];
+	static usb_frame_t frame;
+
+	for (;;)
+	{
+		// Block until the host sends something
+		size_t received = usb_receive(rx_buff, sizeof(rx_buff), portMAX_DELAY);
+
+		for(size_t i = 0; i < received; i++)
+		{
+			if(usb_parse_byte(rx_buff[i], &frame))
+			{
+				handle_command(&frame);
+			}
+		}
+	}
+}
+
+/*
+*	\brief Creates the host command task
+*
+*	\param stack_depth_words The depth of the stack in words
+*	\param task_priority The task priority
+*/
+void create_command_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority)
+{
+	configASSERT(stack_depth_words <= taskCOMMAND_TASK_STACK_SIZE);
+
+	fram_read_done = xSemaphoreCreateBinaryStatic(&fram_read_done_buffer);
+
+	command_task_handle = xTaskCreateStatic(command_task, (const char * const) "COMMAND",
+		stack_depth_words, NULL, task_priority, command_task_stack, &command_task_buffer);
+}
\ No newline at end of file
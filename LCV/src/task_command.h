@@ -0,0 +1,42 @@
+/*MIT License
+
+Copyright (c) 2020 jwachlin
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.*/
+
+/**
+ * \file task_command.h
+ *
+ * \brief Host command handling task
+ *
+ */
+
+
+#ifndef TASK_COMMAND_H_
+#define TASK_COMMAND_H_
+
+#define COMMAND_SETTINGS_PAYLOAD_SIZE		(26)
+#define COMMAND_GAINS_PAYLOAD_SIZE			(32)
+#define COMMAND_FRAM_REQUEST_SIZE			(4)
+#define COMMAND_SCHEDULE_PAYLOAD_SIZE		(1 + GAIN_SCHEDULE_ENTRY_SIZE)	// index, kp, ki, kd
+#define COMMAND_RESPONSE_HEADER_SIZE		(2)		// command type, status
+#define COMMAND_FRAM_TIMEOUT_MS				(10)
+#define COMMAND_FRAM_RETRIES				(5)
+
+#endif /* TASK_COMMAND_H_ */
\ No newline at end of file
@@ -27,6 +27,9 @@ SOFTWARE.*/
  *
  */
 
+#include <math.h>
+#include <string.h>
+
 #include "task_monitor.h"
 #include "task_hmi.h"
 #include "task_sensor.h"
@@ -34,32 +37,37 @@ SOFTWARE.*/
 #include "lib/alarm_monitoring.h"
 #include "lib/adc_interface.h"
 #include "lib/controller.h"
+#include "lib/feedforward.h"
+#include "lib/gain_schedule.h"
 #include "lib/motor_interface.h"
+#include "lib/motor_speed.h"
+#include "lib/motor_thermal.h"
 #include "lib/fm25l16b.h"
-#include "lib/usb_interface.h"
+#include "lib/heartbeat.h"
+#include "lib/latency.h"
+#include "lib/telemetry.h"
+#include "lib/timebase.h"
 
 #include "task_control.h"
 
 // Task handle
 static TaskHandle_t control_task_handle = NULL;
-
-static TimerHandle_t adc_timer_handle = NULL;
+static StaticTask_t control_task_buffer;
+static StackType_t control_task_stack[taskCONTROL_TASK_STACK_SIZE];
 
 static lcv_state_t lcv_state;
 static lcv_control_t lcv_control;
 
 static volatile bool settings_changed = true;
 
-/*
-*	\brief Timer callback for requesting ADC read
-*
-*	\param xTimer The timer handle
-*/
-static void vADCRequestTriggerCallback( TimerHandle_t xTimer )
-{
-	UNUSED(xTimer);
-	adc_request_update();
-}
+static controller_param_t control_params;
+static controller_param_t pending_control_params;
+static volatile bool control_params_changed = false;
+static volatile bool kf_changed = false;
+static controller_param_t scheduled_params;	// control_params with the scheduled gains for the settings
+static volatile bool schedule_pending = true;
+
+static volatile uint32_t control_time_us = 0;
 
 static void update_parameters_from_sensors(lcv_state_t * state, lcv_control_t * control)
 {
@@ -87,6 +95,8 @@ static void control_task(void * pvParameters)
 	lcv_state.setting_state.peep_cm_h20 = 14;
 	lcv_state.setting_state.pip_cm_h20 = 30;
 	lcv_state.setting_state.breath_per_min = 20;
+	lcv_state.setting_state.rise_time_ms = 200;
+	lcv_state.setting_state.fall_time_ms = 200;
 
 	// Load from FRAM asynchronously
 	fram_load_parameters_asynch();
@@ -96,71 +106,126 @@ static void control_task(void * pvParameters)
 	lcv_state.current_state = lcv_state.setting_state;
 
 	// Set initial control settings
-	lcv_control.peep_to_pip_rampup_ms = 200;
-	lcv_control.pip_to_peep_rampdown_ms = 200;
-
 	calculate_lcv_control_params(&lcv_state, &lcv_control);
 
-	adc_timer_handle = xTimerCreate("ADCTH",
-		pdMS_TO_TICKS(2),
-		pdTRUE,
-		(void *) 0,
-		vADCRequestTriggerCallback);
-
-	if(adc_timer_handle)
-	{
-		xTimerStart(adc_timer_handle, 0);
-	}
-
 	const TickType_t xFrequency = pdMS_TO_TICKS(10);	// 100 Hz rate
 	TickType_t xLastWakeTime = xTaskGetTickCount();
 
-	controller_param_t control_params;
 	control_params.kf = 0.05; 
 	control_params.kp = 0.01; 
 	control_params.kd = 0.0;
-	control_params.ki = 0.0;
+	control_params.ki = 0.0005;	// Back-calculation keeps it from winding up on each rise
 	control_params.integral_enable_error_range = 35.0;
 	control_params.integral_antiwindup = 0.3;
 	control_params.max_output = 1.0;
 	control_params.min_output = 0.0;
 
+	// Replaced by the learned map if one was saved
+	feedforward_seed(control_params.kf);
+	int32_t tries = 0;
+	while(!feedforward_load_asynch() && tries++ < 5)
+	{
+		vTaskDelay(pdMS_TO_TICKS(1));
+	}
+	gain_schedule_load();
+
 	init_motor_interface();
 
+	telemetry_register(TELEMETRY_PRESSURE_SET_POINT, TELEMETRY_FLOAT, &lcv_control.pressure_set_point_cm_h20);
+	telemetry_register(TELEMETRY_CONTROL_TIME_US, TELEMETRY_U32, &control_time_us);
+
 	for (;;)
 	{
 		// Ensure constant period, but don't use timer so that we have the defined priority of this task
 		vTaskDelayUntil( &xLastWakeTime, xFrequency);
+		uint32_t start_time_us = get_time_us();
+		latency_mark(LATENCY_CONTROL_WAKE);
 
-		// Ensure at least control is not locked by feeding here
-		wdt_reset_count();
-
-		// Feed hardware watchdog
-		ioport_set_pin_level(WATCHDOG_GPIO, !ioport_get_pin_level(WATCHDOG_GPIO));
+		// Watchdogs are fed by the supervisor while every task beats
+		heartbeat_beat(HEARTBEAT_CONTROL);
 
 		// Update sensor data if possible
 		update_parameters_from_sensors(&lcv_state, &lcv_control);
 
-		// Save if changed 
+		// Save if changed, retry next tick if the FRAM is busy
 		if(settings_changed)
 		{
-			fram_save_parameters_asynch(&lcv_state.setting_state);
-			settings_changed = false;
+			if(fram_save_parameters_asynch(&lcv_state.setting_state))
+			{
+				settings_changed = false;
+			}
+		}
+		else if(gain_schedule_save_due())
+		{
+			// Entries set by the host, one FRAM write per tick
+			gain_schedule_save_asynch();
+		}
+		else if(feedforward_save_due())
+		{
+			// Persist what the feedforward has learned now and then
+			feedforward_save_asynch();
+		}
+
+		// Apply new gains between controller runs only
+		if(control_params_changed)
+		{
+			taskENTER_CRITICAL();
+			control_params = pending_control_params;
+			control_params_changed = false;
+			bool reseed = kf_changed;
+			kf_changed = false;
+			taskEXIT_CRITICAL();
+
+			// A new kf starts learning over from its straight line
+			if(reseed)
+			{
+				feedforward_seed(control_params.kf);
+			}
+			schedule_pending = true;
+		}
+
+		// Interpolate the gain schedule only when the settings or the schedule change
+		if(gain_schedule_changed() || schedule_pending)
+		{
+			schedule_pending = false;
+			scheduled_params = control_params;
+			gain_schedule_apply(&lcv_state.setting_state, &scheduled_params);
 		}
 
-		float motor_output = run_controller(&lcv_state, &lcv_control, &control_params);
+		// A hot motor caps the output, the controller clamps and limits its integral to it
+		controller_param_t limited_params = scheduled_params;
+		limited_params.max_output = fminf(scheduled_params.max_output, motor_thermal_output_limit());
+
+		float motor_output = run_controller(&lcv_state, &lcv_control, &limited_params);
+		latency_mark(LATENCY_CONTROLLER_OUTPUT);
 		if(lcv_state.current_state.enable)
 		{
 			enable_motor();
-			float output_sent = drive_motor(motor_output);
-			usb_transmit_control(&lcv_control, output_sent);
+			if(MOTOR_SPEED_LOOP_ENABLE)
+			{
+				// Output is a speed set point for the inner loop in the tick hook
+				motor_speed_loop_set_point(motor_output);
+				motor_speed_loop_start();
+				controller_set_applied_output(motor_output);
+			}
+			else
+			{
+				controller_set_applied_output(drive_motor(motor_output));
+			}
 		}
 		else
 		{
 			disable_motor();
+			motor_speed_loop_stop();
 			drive_motor(0.0);
+
+			// Disabling the system acknowledges an overpressure cutoff
+			motor_overpressure_clear();
 		}
 
+		control_time_us = get_time_us() - start_time_us;
+
+		telemetry_sample();
 	}
 }
 
@@ -173,8 +238,10 @@ static void control_task(void * pvParameters)
 
 void create_control_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority)
 {
-	xTaskCreate(control_task, (const char * const) "CONTROL",
-	stack_depth_words, NULL, task_priority, &control_task_handle);
+	configASSERT(stack_depth_words <= taskCONTROL_TASK_STACK_SIZE);
+
+	control_task_handle = xTaskCreateStatic(control_task, (const char * const) "CONTROL",
+	stack_depth_words, NULL, task_priority, control_task_stack, &control_task_buffer);
 }
 
 /*
@@ -198,6 +265,40 @@ void update_settings(lcv_parameters_t * new_settings)
 	lcv_state.setting_state = *new_settings;
 
 	settings_changed = true;
+	schedule_pending = true;
 
 	calculate_lcv_control_params(&lcv_state, &lcv_control);
+}
+
+/*
+*	\brief Gets the base controller gains, kp, ki and kd come from the gain schedule once it is complete
+*
+*	\return The controller parameters
+*/
+controller_param_t get_controller_params(void)
+{
+	controller_param_t params;
+	taskENTER_CRITICAL();
+	params = control_params_changed ? pending_control_params : control_params;
+	taskEXIT_CRITICAL();
+	return params;
+}
+
+/*
+*	\brief Updates the controller gains, applied at the start of the next control cycle
+*
+*	\param new_params Pointer to the new controller parameters
+*/
+void update_controller_params(controller_param_t * new_params)
+{
+	taskENTER_CRITICAL();
+	// Compared as bits, any change to kf reseeds the feedforward map
+	controller_param_t * latest = control_params_changed ? &pending_control_params : &control_params;
+	if(memcmp(&new_params->kf, &latest->kf, sizeof(new_params->kf)) != 0)
+	{
+		kf_changed = true;
+	}
+	pending_control_params = *new_params;
+	control_params_changed = true;
+	taskEXIT_CRITICAL();
 }
\ No newline at end of file
@@ -39,6 +39,8 @@ typedef struct
 	int32_t peep_cm_h20;
 	int32_t pip_cm_h20;
 	int32_t breath_per_min;
+	int32_t rise_time_ms;	// PEEP to PIP transition
+	int32_t fall_time_ms;	// PIP to PEEP transition
 } lcv_parameters_t;
 
 typedef struct  
@@ -47,17 +49,33 @@ typedef struct
 	lcv_parameters_t current_state;
 } lcv_state_t;
 
+typedef enum
+{
+	PROFILE_STAGE_RISE=0,
+	PROFILE_STAGE_PIP_HOLD=1,
+	PROFILE_STAGE_FALL=2,
+	PROFILE_STAGE_PEEP_HOLD=3
+} PROFILE_STAGE;
+
 typedef struct
 {
+	PROFILE_STAGE profile_stage;	// Where the set point is in the breath
 	int32_t peep_to_pip_rampup_ms;
 	int32_t pip_hold_ms;
 	int32_t pip_to_peep_rampdown_ms;
 	int32_t peep_hold_ms;
-	int32_t pressure_set_point_cm_h20;
+	float rampup_inverse_ms;	// Precomputed with the profile so the per tick evaluation has no division
+	float rampdown_inverse_ms;
+	float pressure_set_point_cm_h20;
 	int32_t pressure_current_cm_h20;
 } lcv_control_t;
 
+// Needs the types above
+#include "lib/controller.h"
+
 lcv_parameters_t get_current_settings(void);
 void update_settings(lcv_parameters_t * new_settings);
+controller_param_t get_controller_params(void);
+void update_controller_params(controller_param_t * new_params);
 
 #endif /* TASK_CONTROL_H_ */
\ No newline at end of file
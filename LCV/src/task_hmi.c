@@ -31,6 +31,9 @@ SOFTWARE.*/
 #include "lib/lcd_interface.h"
 #include "lib/alarm_monitoring.h"
 #include "lib/adc_interface.h"
+#include "lib/heartbeat.h"
+#include "lib/motor_interface.h"
+#include "lib/setting_input.h"
 #include "task_control.h"
 
 #include "task_hmi.h"
@@ -39,42 +42,106 @@ SOFTWARE.*/
 
 #define LCD_SERCOM					SERCOM1
 #define LCD_SERCOM_IRQn				SERCOM1_IRQn
+#define LCD_I2C_TIMEOUT_MS			(30)
+
+#define INPUT_ENABLE_EXTINT			(11)	// PB11
+#define INPUT_PUSHBUTTON_EXTINT		(12)	// PA12
+#define INPUT_DEBOUNCE_MS			(20)
+
+#define SETTINGS_RAMP_STEP_MS		(10)	// One knob step of rise or fall time
+
+// Work requested by the timers, as task notification bits
+#define DISPLAY_NOTIFY_REFRESH		(1 << 0)
+#define DISPLAY_NOTIFY_PAGE			(1 << 1)
 
 // Task handle
 static TaskHandle_t hmi_task_handle = NULL;
+static TaskHandle_t display_task_handle = NULL;
 static TaskHandle_t lcd_i2c_task_handle = NULL;
 
 static TimerHandle_t screen_update_handle = NULL;
 static TimerHandle_t screen_change_handle = NULL;
-static TimerHandle_t i2c_timeout_timer_handle = NULL;
+
+static TimerHandle_t enable_debounce_handle = NULL;
+static TimerHandle_t pushbutton_debounce_handle = NULL;
 
 static QueueHandle_t lcd_i2c_queue = NULL;
+
+// Static storage for the kernel objects above
+static StaticTask_t hmi_task_buffer;
+static StaticTask_t display_task_buffer;
+static StaticTask_t lcd_i2c_task_buffer;
+static StackType_t hmi_task_stack[taskHMI_TASK_STACK_SIZE];
+static StackType_t display_task_stack[taskDISPLAY_TASK_STACK_SIZE];
+static StackType_t lcd_i2c_task_stack[taskI2C_TASK_STACK_SIZE];
+static StaticTimer_t screen_update_buffer;
+static StaticTimer_t screen_change_buffer;
+static StaticTimer_t enable_debounce_buffer;
+static StaticTimer_t pushbutton_debounce_buffer;
+static StaticQueue_t lcd_i2c_queue_buffer;
+static uint8_t lcd_i2c_queue_storage[LCD_I2C_QUEUE_SIZE * sizeof(i2c_transaction_t)];
 static struct i2c_master_module i2c_master_instance;
 
 static bool display_main_page = true;
 
+// Debounced front panel inputs
+static volatile bool system_enabled = false;
+static bool pushbutton_pressed = false;
+
 static SETTINGS_INPUT_STAGE stage = STAGE_NONE;
 static lcv_parameters_t settings_input;
 static const lcv_parameters_t lower_settings_range = {.enable = 0, .tidal_volume_ml = 100,
-.peep_cm_h20 = 3, .pip_cm_h20 = 10, .breath_per_min = 6, .ie_ratio_tenths=5};
+.peep_cm_h20 = 3, .pip_cm_h20 = 10, .breath_per_min = 6, .ie_ratio_tenths=5, .rise_time_ms = 50, .fall_time_ms = 50};
 
 static const lcv_parameters_t upper_settings_range = {.enable = 0, .tidal_volume_ml = 2500,
-.peep_cm_h20 = 20, .pip_cm_h20 = 35, .breath_per_min = 60, .ie_ratio_tenths=40};
+.peep_cm_h20 = 20, .pip_cm_h20 = 35, .breath_per_min = 60, .ie_ratio_tenths=40, .rise_time_ms = 1000, .fall_time_ms = 1000};
+
 
+/*
+*	\brief Gets the longest a rise or fall can be and still leave time in the breath for the holds
+*
+*	\param other_ramp_ms The other transition's time
+*	\param lower_ms The transition's own lower limit
+*	\param upper_ms The transition's own upper limit
+*
+*	\return The limit in knob steps, never below the lower limit
+*/
+static int32_t ramp_upper_steps(int32_t other_ramp_ms, int32_t lower_ms, int32_t upper_ms)
+{
+	int32_t upper = (60000 / settings_input.breath_per_min) - other_ramp_ms - SETTINGS_RAMP_STEP_MS;
+	if(upper > upper_ms)
+	{
+		upper = upper_ms;
+	}
+	if(upper < lower_ms)
+	{
+		upper = lower_ms;
+	}
+	return upper / SETTINGS_RAMP_STEP_MS;
+}
 
 static void handle_hmi_input(void)
 {
-	static bool last_button_status = false;
-	// Check for stage change
-	bool new_button_status = get_pushbutton_level();
+	// Every debounced press since the last run advances the stage
+	uint32_t presses = ulTaskNotifyTake(pdTRUE, 0);
 
-	if(!last_button_status && new_button_status)
+	while(presses-- > 0)
 	{
 		switch (stage)
 		{
 			case STAGE_NONE:
+			{
+				// Start from the settings in use, the knob adjusts them
+				lcv_parameters_t current = get_current_settings();
+				settings_input.breath_per_min = current.breath_per_min;
+				settings_input.peep_cm_h20 = current.peep_cm_h20;
+				settings_input.pip_cm_h20 = current.pip_cm_h20;
+				settings_input.ie_ratio_tenths = current.ie_ratio_tenths;
+				settings_input.rise_time_ms = current.rise_time_ms;
+				settings_input.fall_time_ms = current.fall_time_ms;
 				stage = STAGE_BPM;
 				break;
+			}
 
 			case STAGE_BPM:
 				stage = STAGE_PEEP;
@@ -89,6 +156,14 @@ static void handle_hmi_input(void)
 				break;
 
 			case STAGE_IE:
+				stage = STAGE_RISE;
+				break;
+
+			case STAGE_RISE:
+				stage = STAGE_FALL;
+				break;
+
+			case STAGE_FALL:
 				// Save settings
 				update_settings(&settings_input);
 				stage = STAGE_NONE;
@@ -98,35 +173,48 @@ static void handle_hmi_input(void)
 				stage = STAGE_NONE;
 				break;
 		}
+
+		// Turns made for the previous setting do not carry over
+		setting_input_reset();
 	}
 
 	// Handle the stage
 
-	float knob_portion = get_input_potentiometer_portion();
-
 	switch (stage)
 	{
 		case STAGE_NONE:
 		break;
 
 		case STAGE_BPM:
-			settings_input.breath_per_min = (int32_t) lower_settings_range.breath_per_min +
-			knob_portion * (upper_settings_range.breath_per_min - lower_settings_range.breath_per_min);
+			settings_input.breath_per_min = setting_input_apply(settings_input.breath_per_min,
+				lower_settings_range.breath_per_min, upper_settings_range.breath_per_min);
 			break;
 
 		case STAGE_PEEP:
-			settings_input.peep_cm_h20 = (int32_t) lower_settings_range.peep_cm_h20 +
-			knob_portion * (upper_settings_range.peep_cm_h20 - lower_settings_range.peep_cm_h20);
+			settings_input.peep_cm_h20 = setting_input_apply(settings_input.peep_cm_h20,
+				lower_settings_range.peep_cm_h20, upper_settings_range.peep_cm_h20);
 			break;
 
 		case STAGE_PIP:
-			settings_input.pip_cm_h20 = (int32_t) lower_settings_range.pip_cm_h20 +
-			knob_portion * (upper_settings_range.pip_cm_h20 - lower_settings_range.pip_cm_h20);
+			settings_input.pip_cm_h20 = setting_input_apply(settings_input.pip_cm_h20,
+				lower_settings_range.pip_cm_h20, upper_settings_range.pip_cm_h20);
 			break;
 
 		case STAGE_IE:
-			settings_input.ie_ratio_tenths = (int32_t) lower_settings_range.ie_ratio_tenths +
-			knob_portion * (upper_settings_range.ie_ratio_tenths - lower_settings_range.ie_ratio_tenths);
+			settings_input.ie_ratio_tenths = setting_input_apply(settings_input.ie_ratio_tenths,
+				lower_settings_range.ie_ratio_tenths, upper_settings_range.ie_ratio_tenths);
+			break;
+
+		case STAGE_RISE:
+			settings_input.rise_time_ms = SETTINGS_RAMP_STEP_MS * setting_input_apply(settings_input.rise_time_ms / SETTINGS_RAMP_STEP_MS,
+				lower_settings_range.rise_time_ms / SETTINGS_RAMP_STEP_MS, ramp_upper_steps(settings_input.fall_time_ms,
+				lower_settings_range.rise_time_ms, upper_settings_range.rise_time_ms));
+			break;
+
+		case STAGE_FALL:
+			settings_input.fall_time_ms = SETTINGS_RAMP_STEP_MS * setting_input_apply(settings_input.fall_time_ms / SETTINGS_RAMP_STEP_MS,
+				lower_settings_range.fall_time_ms / SETTINGS_RAMP_STEP_MS, ramp_upper_steps(settings_input.rise_time_ms,
+				lower_settings_range.fall_time_ms, upper_settings_range.fall_time_ms));
 			break;
 		
 		default:
@@ -134,19 +222,115 @@ static void handle_hmi_input(void)
 			break;
 	}
 
-	last_button_status = new_button_status;
+}
+
+/*
+*	\brief Enable switch edge, turns the motor off at once when the switch opens
+*
+*	Closing the switch only counts once it is stable, see vEnableDebounceTimerCallback
+*/
+static void enable_switch_extint_cb(void)
+{
+	BaseType_t higher_priority_task_woken = pdFALSE;
+
+	if(ioport_get_pin_level(INPUT_ENABLE_GPIO) != IOPORT_PIN_LEVEL_HIGH)
+	{
+		system_enabled = false;
+		disable_motor();
+	}
+
+	xTimerResetFromISR(enable_debounce_handle, &higher_priority_task_woken);
+	portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static void pushbutton_extint_cb(void)
+{
+	BaseType_t higher_priority_task_woken = pdFALSE;
+	xTimerResetFromISR(pushbutton_debounce_handle, &higher_priority_task_woken);
+	portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static void vEnableDebounceTimerCallback( TimerHandle_t xTimer )
+{
+	UNUSED(xTimer);
+	system_enabled = (ioport_get_pin_level(INPUT_ENABLE_GPIO) == IOPORT_PIN_LEVEL_HIGH);
+}
+
+static void vPushbuttonDebounceTimerCallback( TimerHandle_t xTimer )
+{
+	UNUSED(xTimer);
+
+	bool level = get_pushbutton_level();
+	if(level && !pushbutton_pressed)
+	{
+		xTaskNotifyGive(hmi_task_handle);
+	}
+	pushbutton_pressed = level;
+}
+
+/*
+*	\brief Sets up the enable switch and pushbutton on EIC interrupts, both edges
+*
+*	An edge restarts that input's debounce timer, the input is read once it has been stable
+*	for INPUT_DEBOUNCE_MS.
+*/
+static void front_panel_inputs_setup(void)
+{
+	struct extint_chan_conf config_extint_chan;
+
+	enable_debounce_handle = xTimerCreateStatic("ENBL_DB",
+		pdMS_TO_TICKS(INPUT_DEBOUNCE_MS),
+		pdFALSE,
+		(void *) 0,
+		vEnableDebounceTimerCallback,
+		&enable_debounce_buffer);
+
+	pushbutton_debounce_handle = xTimerCreateStatic("BTN_DB",
+		pdMS_TO_TICKS(INPUT_DEBOUNCE_MS),
+		pdFALSE,
+		(void *) 0,
+		vPushbuttonDebounceTimerCallback,
+		&pushbutton_debounce_buffer);
+
+	extint_chan_get_config_defaults(&config_extint_chan);
+	config_extint_chan.gpio_pin_pull = EXTINT_PULL_DOWN;
+	config_extint_chan.detection_criteria = EXTINT_DETECT_BOTH;
+	config_extint_chan.filter_input_signal = true;
+
+	config_extint_chan.gpio_pin = PIN_PB11A_EIC_EXTINT11;
+	config_extint_chan.gpio_pin_mux = MUX_PB11A_EIC_EXTINT11;
+	extint_chan_set_config(INPUT_ENABLE_EXTINT, &config_extint_chan);
+
+	config_extint_chan.gpio_pin = PIN_PA12A_EIC_EXTINT12;
+	config_extint_chan.gpio_pin_mux = MUX_PA12A_EIC_EXTINT12;
+	extint_chan_set_config(INPUT_PUSHBUTTON_EXTINT, &config_extint_chan);
+
+	// Uses FreeRTOS, so need to limit priority
+	irq_register_handler(EIC_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+	extint_register_callback(enable_switch_extint_cb, INPUT_ENABLE_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+	extint_chan_enable_callback(INPUT_ENABLE_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+	extint_register_callback(pushbutton_extint_cb, INPUT_PUSHBUTTON_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+	extint_chan_enable_callback(INPUT_PUSHBUTTON_EXTINT, EXTINT_CALLBACK_TYPE_DETECT);
+
+	// Take the current levels once stable, a switch already closed at boot has no edge
+	xTimerStart(enable_debounce_handle, 0);
+	xTimerStart(pushbutton_debounce_handle, 0);
 }
 
 static void vScreenChangeTimerCallback( TimerHandle_t xTimer )
 {
 	UNUSED(xTimer);
-	display_main_page = !display_main_page;
+	xTaskNotify(display_task_handle, DISPLAY_NOTIFY_PAGE, eSetBits);
 }
 
 static void vScreenRefreshTimerCallback( TimerHandle_t xTimer )
 {
 	UNUSED(xTimer);
-	
+	xTaskNotify(display_task_handle, DISPLAY_NOTIFY_REFRESH, eSetBits);
+}
+
+static void refresh_screen(void)
+{
 	// Don't display alarm page if no alarms
 	if(!display_main_page)
 	{
@@ -166,17 +350,13 @@ static void vScreenRefreshTimerCallback( TimerHandle_t xTimer )
 	}
 }
 
-static void vI2CTimeoutTimerCallback( TimerHandle_t xTimer )
-{
-	UNUSED(xTimer);
-	vTaskResume(lcd_i2c_task_handle);
-}
-
 static void handle_i2c_write_complete(struct i2c_master_module *const module)
 {
 	 enum status_code status = i2c_master_get_job_status(module);
+	BaseType_t higher_priority_task_woken = pdFALSE;
 
-	xTaskResumeFromISR(lcd_i2c_task_handle);
+	vTaskNotifyGiveFromISR(lcd_i2c_task_handle, &higher_priority_task_woken);
+	portYIELD_FROM_ISR(higher_priority_task_woken);
 }
 
 static void lcd_i2c_hw_setup(void)
@@ -209,21 +389,24 @@ static void hmi_task(void * pvParameters)
 	lcd_i2c_hw_setup();
 	lcd_init();
 
-	screen_update_handle = xTimerCreate("SCREEN_TIM",
+	// Timers only notify the display task, which does the LCD writes
+	screen_update_handle = xTimerCreateStatic("SCREEN_TIM",
 				pdMS_TO_TICKS(30),
 				pdTRUE,
 				(void *) 0,
-				vScreenRefreshTimerCallback);
+				vScreenRefreshTimerCallback,
+				&screen_update_buffer);
 	if(screen_update_handle)
 	{
 		xTimerStart(screen_update_handle, 0);
 	}
 
-	screen_change_handle = xTimerCreate("SCREEN_CHG",
+	screen_change_handle = xTimerCreateStatic("SCREEN_CHG",
 		pdMS_TO_TICKS(2000),
 		pdTRUE,
 		(void *) 0,
-		vScreenChangeTimerCallback);
+		vScreenChangeTimerCallback,
+		&screen_change_buffer);
 	if(screen_change_handle)
 	{
 		xTimerStart(screen_change_handle, 0);
@@ -237,6 +420,8 @@ static void hmi_task(void * pvParameters)
 		// Ensure constant period, but don't use timer so that we have the defined priority of this task
 		vTaskDelayUntil( &xLastWakeTime, xFrequency);
 
+		heartbeat_beat(HEARTBEAT_HMI);
+
 		handle_hmi_input();
 		// Actual display write and screen changes happens in timers. Here we just update buffers
 		update_main_buffer(&settings_input, stage);
@@ -245,15 +430,35 @@ static void hmi_task(void * pvParameters)
 	}
 }
 
-static void lcd_i2c_task(void * pvParameters)
+/*
+*	\brief The display task, writes the screen buffers to the LCD when notified
+*/
+static void display_task(void * pvParameters)
 {
 	UNUSED(pvParameters);
 
-	i2c_timeout_timer_handle = xTimerCreate("I2C_TIMEOUT",
-		pdMS_TO_TICKS(30),
-		pdFALSE,
-		(void *) 0,
-		vI2CTimeoutTimerCallback);
+	uint32_t notified;
+
+	for (;;)
+	{
+		xTaskNotifyWait(0, UINT32_MAX, &notified, portMAX_DELAY);
+
+		if(notified & DISPLAY_NOTIFY_PAGE)
+		{
+			display_main_page = !display_main_page;
+		}
+
+		if(notified & DISPLAY_NOTIFY_REFRESH)
+		{
+			refresh_screen();
+			heartbeat_beat(HEARTBEAT_DISPLAY);
+		}
+	}
+}
+
+static void lcd_i2c_task(void * pvParameters)
+{
+	UNUSED(pvParameters);
 
 	i2c_transaction_t transaction;
 
@@ -261,13 +466,17 @@ static void lcd_i2c_task(void * pvParameters)
 	{
 		if(xQueueReceive(lcd_i2c_queue, &transaction,portMAX_DELAY) == pdTRUE)
 		{
+			// Drop a completion that arrived after its timeout
+			ulTaskNotifyTake(pdTRUE, 0);
+
 			// Send transaction
 			i2c_master_write_packet_job(&i2c_master_instance, &transaction.packet);
 
-			// Set up timeout timer
-			xTimerReset(i2c_timeout_timer_handle, 0);
-
-			vTaskSuspend(lcd_i2c_task_handle);
+			// Wait for completion or timeout, a bus that stops completing stops the heartbeat
+			if(ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LCD_I2C_TIMEOUT_MS)) > 0)
+			{
+				heartbeat_beat(HEARTBEAT_I2C);
+			}
 		}
 	}
 }
@@ -281,23 +490,34 @@ static void lcd_i2c_task(void * pvParameters)
 
 void create_hmi_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority)
 {
-	lcd_i2c_queue = xQueueCreate(LCD_I2C_QUEUE_SIZE, sizeof(i2c_transaction_t));
+	configASSERT(stack_depth_words <= taskHMI_TASK_STACK_SIZE);
+
+	front_panel_inputs_setup();
+	setting_input_init();
+
+	lcd_i2c_queue = xQueueCreateStatic(LCD_I2C_QUEUE_SIZE, sizeof(i2c_transaction_t),
+		lcd_i2c_queue_storage, &lcd_i2c_queue_buffer);
 
-	xTaskCreate(hmi_task, (const char * const) "HMI",
-		stack_depth_words, NULL, task_priority, &hmi_task_handle);
+	hmi_task_handle = xTaskCreateStatic(hmi_task, (const char * const) "HMI",
+		stack_depth_words, NULL, task_priority, hmi_task_stack, &hmi_task_buffer);
 
-	xTaskCreate(lcd_i2c_task, (const char * const) "I2C",
-		256, NULL, task_priority, &lcd_i2c_task_handle);
+	display_task_handle = xTaskCreateStatic(display_task, (const char * const) "DISPLAY",
+		taskDISPLAY_TASK_STACK_SIZE, NULL, taskDISPLAY_TASK_PRIORITY, display_task_stack, &display_task_buffer);
+
+	lcd_i2c_task_handle = xTaskCreateStatic(lcd_i2c_task, (const char * const) "I2C",
+		taskI2C_TASK_STACK_SIZE, NULL, taskI2C_TASK_PRIORITY, lcd_i2c_task_stack, &lcd_i2c_task_buffer);
 }
 
 /*
 *	\brief Checks is the system enable switch is on
 *
+*	Debounced when closing, immediate when opening
+*
 *	\return True if enabled, false otherwise
 */
 bool system_is_enabled(void)
 {
-	return (ioport_get_pin_level(INPUT_ENABLE_GPIO) == IOPORT_PIN_LEVEL_HIGH);
+	return system_enabled;
 }
 
 /*
@@ -310,6 +530,31 @@ bool get_pushbutton_level(void)
 	return ioport_get_pin_level(INPUT_PUSHBUTTON_GPIO);
 }
 
+/*
+*	\brief Checks settings against the range allowed from the front panel
+*
+*	\param settings Pointer to the settings to check
+*
+*	\return True if every setting is within range
+*/
+bool settings_in_range(lcv_parameters_t * settings)
+{
+	return (settings->breath_per_min >= lower_settings_range.breath_per_min &&
+		settings->breath_per_min <= upper_settings_range.breath_per_min &&
+		settings->peep_cm_h20 >= lower_settings_range.peep_cm_h20 &&
+		settings->peep_cm_h20 <= upper_settings_range.peep_cm_h20 &&
+		settings->pip_cm_h20 >= lower_settings_range.pip_cm_h20 &&
+		settings->pip_cm_h20 <= upper_settings_range.pip_cm_h20 &&
+		settings->peep_cm_h20 < settings->pip_cm_h20 &&
+		settings->ie_ratio_tenths >= lower_settings_range.ie_ratio_tenths &&
+		settings->ie_ratio_tenths <= upper_settings_range.ie_ratio_tenths &&
+		settings->rise_time_ms >= lower_settings_range.rise_time_ms &&
+		settings->rise_time_ms <= upper_settings_range.rise_time_ms &&
+		settings->fall_time_ms >= lower_settings_range.fall_time_ms &&
+		settings->fall_time_ms <= upper_settings_range.fall_time_ms &&
+		(settings->rise_time_ms + settings->fall_time_ms) < (60000 / settings->breath_per_min));
+}
+
 void add_lcd_i2c_transaction_to_queue(i2c_transaction_t transaction)
 {
 	if(lcd_i2c_queue)
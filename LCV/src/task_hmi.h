@@ -31,13 +31,17 @@ SOFTWARE.*/
 #ifndef TASK_HMI_H_
 #define TASK_HMI_H_
 
+#include "task_control.h"
+
 typedef enum
 {
 	STAGE_NONE=0,
 	STAGE_BPM=1,
 	STAGE_PEEP=2,
 	STAGE_PIP=3,
-	STAGE_IE=4
+	STAGE_IE=4,
+	STAGE_RISE=5,
+	STAGE_FALL=6
 } SETTINGS_INPUT_STAGE;
 
 typedef struct 
@@ -47,6 +51,7 @@ typedef struct
 
 bool system_is_enabled(void);
 bool get_pushbutton_level(void);
+bool settings_in_range(lcv_parameters_t * settings);
 void add_lcd_i2c_transaction_to_queue(i2c_transaction_t transaction);
 
 #endif /* TASK_HMI_H_ */
\ No newline at end of file
@@ -30,17 +30,123 @@ SOFTWARE.*/
 #include "task_monitor.h"
 
 #include "lib/alarm_monitoring.h"
+#include "lib/heartbeat.h"
+#include "lib/usb_interface.h"
+
+#define MONITOR_PERIOD_MS			(100)
+#define TASK_STATS_PERIOD_MS		(1000)
+#define TASK_STATS_MAX_TASKS		(12)
+#define TASK_STATS_HEADER_SIZE		(5)		// total run time, task count
+#define TASK_STATS_ENTRY_SIZE		(configMAX_TASK_NAME_LEN + 6)	// name, number, priority, CPU share, stack high water
 
 // Task handle
 static TaskHandle_t monitor_task_handle = NULL;
+static StaticTask_t monitor_task_buffer;
+static StackType_t monitor_task_stack[taskMONITOR_TASK_STACK_SIZE];
+
+static TaskStatus_t task_status[TASK_STATS_MAX_TASKS];
+static uint32_t last_run_time_task_number[TASK_STATS_MAX_TASKS];
+static uint32_t last_run_time[TASK_STATS_MAX_TASKS];
+static uint32_t last_total_run_time = 0;
+static uint8_t task_stats_payload[TASK_STATS_HEADER_SIZE + (TASK_STATS_ENTRY_SIZE * TASK_STATS_MAX_TASKS)];
+
+/*
+*	\brief Gets the run time a task had at the previous snapshot
+*
+*	\param task_number The FreeRTOS task number
+*
+*	\return The run time in microseconds, 0 if the task is new
+*/
+static uint32_t get_last_run_time(uint32_t task_number)
+{
+	uint8_t i;
+	for(i = 0; i < TASK_STATS_MAX_TASKS; i++)
+	{
+		if(last_run_time_task_number[i] == task_number)
+		{
+			return last_run_time[i];
+		}
+	}
+	return 0;
+}
+
+/*
+*	\brief Sends each task's CPU share since the last snapshot and its stack high water mark
+*
+*	CPU share is in hundredths of a percent, stack high water mark is the least free stack
+*	seen, in words.
+*/
+static void send_task_stats(void)
+{
+	uint32_t total_run_time;
+	UBaseType_t num_tasks = uxTaskGetSystemState(task_status, TASK_STATS_MAX_TASKS, &total_run_time);
+	uint32_t period = total_run_time - last_total_run_time;
+	UBaseType_t i;
+
+	memcpy(&task_stats_payload[0], &period, 4);
+	task_stats_payload[4] = (uint8_t) num_tasks;
+
+	for(i = 0; i < num_tasks; i++)
+	{
+		TaskStatus_t * status = &task_status[i];
+		uint8_t * entry = &task_stats_payload[TASK_STATS_HEADER_SIZE + (i * TASK_STATS_ENTRY_SIZE)];
+
+		uint32_t run_time = status->ulRunTimeCounter - get_last_run_time(status->xTaskNumber);
+		uint16_t share = (period > 0) ? (uint16_t) (((uint64_t) run_time * 10000) / period) : 0;
+		uint16_t high_water = status->usStackHighWaterMark;
+
+		memset(entry, 0, configMAX_TASK_NAME_LEN);
+		strncpy((char *) entry, status->pcTaskName, configMAX_TASK_NAME_LEN);
+		entry[configMAX_TASK_NAME_LEN] = (uint8_t) status->xTaskNumber;
+		entry[configMAX_TASK_NAME_LEN + 1] = (uint8_t) status->uxCurrentPriority;
+		memcpy(&entry[configMAX_TASK_NAME_LEN + 2], &share, 2);
+		memcpy(&entry[configMAX_TASK_NAME_LEN + 4], &high_water, 2);
+	}
+
+	// Remember this snapshot, after all deltas are taken
+	for(i = 0; i < TASK_STATS_MAX_TASKS; i++)
+	{
+		last_run_time_task_number[i] = (i < num_tasks) ? task_status[i].xTaskNumber : 0;
+		last_run_time[i] = (i < num_tasks) ? task_status[i].ulRunTimeCounter : 0;
+	}
+	last_total_run_time = total_run_time;
+
+	usb_send_frame(USB_FRAME_TASK_STATS, xTaskGetTickCount() * portTICK_PERIOD_MS, task_stats_payload,
+		TASK_STATS_HEADER_SIZE + (num_tasks * TASK_STATS_ENTRY_SIZE));
+}
 
 static void monitor_task(void * pvParameters)
 {
 	UNUSED(pvParameters);
+
+	uint32_t monitor_elapsed_ms = 0;
+	uint32_t stats_elapsed_ms = 0;
+
+	alarm_monitoring_init();
+
+	const TickType_t xFrequency = pdMS_TO_TICKS(HEARTBEAT_SUPERVISE_PERIOD_MS);
+	TickType_t xLastWakeTime = xTaskGetTickCount();
 	
 	for (;;)
 	{
-		vTaskDelay(pdMS_TO_TICKS(100));
+		vTaskDelayUntil( &xLastWakeTime, xFrequency);
+
+		// Watchdogs are only fed while every supervised task is on time
+		heartbeat_supervise();
+
+		monitor_elapsed_ms += HEARTBEAT_SUPERVISE_PERIOD_MS;
+		if(monitor_elapsed_ms < MONITOR_PERIOD_MS)
+		{
+			continue;
+		}
+		monitor_elapsed_ms = 0;
+
+		stats_elapsed_ms += MONITOR_PERIOD_MS;
+		if(stats_elapsed_ms >= TASK_STATS_PERIOD_MS)
+		{
+			stats_elapsed_ms = 0;
+			send_task_stats();
+		}
 
 		if(any_alarms_set())
 		{
@@ -62,6 +168,8 @@ static void monitor_task(void * pvParameters)
 */
 void create_monitor_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority)
 {
-	xTaskCreate(monitor_task, (const char * const) "MONITOR",
-		stack_depth_words, NULL, task_priority, &monitor_task_handle);
+	configASSERT(stack_depth_words <= taskMONITOR_TASK_STACK_SIZE);
+
+	monitor_task_handle = xTaskCreateStatic(monitor_task, (const char * const) "MONITOR",
+		stack_depth_words, NULL, task_priority, monitor_task_stack, &monitor_task_buffer);
 }
\ No newline at end of file
@@ -37,19 +37,26 @@ SOFTWARE.*/
 // Task priorities
 #define taskMONITOR_TASK_PRIORITY		(tskIDLE_PRIORITY+3)
 #define taskCONTROL_TASK_PRIORITY		(tskIDLE_PRIORITY+2)
-#define taskSENSOR_TASK_PRIORITY		(tskIDLE_PRIORITY+2)
+#define taskSENSOR_TASK_PRIORITY		(tskIDLE_PRIORITY+3)	// Triggers ADC scans
 #define taskHMI_TASK_PRIORITY			(tskIDLE_PRIORITY+1)
+#define taskCOMMAND_TASK_PRIORITY		(tskIDLE_PRIORITY+1)
+#define taskDISPLAY_TASK_PRIORITY		(tskIDLE_PRIORITY+1)
+#define taskI2C_TASK_PRIORITY			(tskIDLE_PRIORITY+1)
 
 // Task size allocation in words. Note 1 word = 4 bytes
 #define taskMONITOR_TASK_STACK_SIZE		(256)
 #define taskCONTROL_TASK_STACK_SIZE		(512)
 #define taskSENSOR_TASK_STACK_SIZE		(256)
 #define taskHMI_TASK_STACK_SIZE			(512)
+#define taskCOMMAND_TASK_STACK_SIZE		(256)
+#define taskDISPLAY_TASK_STACK_SIZE		(256)
+#define taskI2C_TASK_STACK_SIZE			(256)
 
 void create_monitor_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority);
 void create_control_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority);
 void create_sensor_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority);
 void create_hmi_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority);
+void create_command_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority);
 
 
 #endif /* TASK_MONITOR_H_ */
\ No newline at end of file
@@ -27,23 +27,62 @@ SOFTWARE.*/
  *
  */
 
+#include <math.h>
+
 #include "task_monitor.h"
 
 #include "lib/flow_sensor_fs6122.h"
 #include "lib/adc_interface.h"
+#include "lib/adc_stream.h"
+#include "lib/heartbeat.h"
+#include "lib/lung_mechanics.h"
+#include "lib/telemetry.h"
+#include "task_control.h"
+#include "task_hmi.h"
 
 #include "task_sensor.h"
 
 #define TIDAL_VOLUME_PERIOD_MS		(10)
+#define ADC_PERIOD_MS				(2)
+#define LEAK_ESTIMATE_GAIN			(0.5)	// Share of each breath's volume imbalance taken into the leak
+#define LEAK_BREATH_TOLERANCE		(0.25)	// Share of the set breath period a detected breath may be off by
+#define LEAK_MIN_SLPM				(-5.0)	// Flow sensor offset
+#define LEAK_MAX_SLPM				(60.0)
+
+// Work requested by the timers, as task notification bits
+#define SENSOR_NOTIFY_ADC			(1 << 0)
+#define SENSOR_NOTIFY_TIDAL_VOLUME	(1 << 1)
+#define SENSOR_NOTIFY_FLOW_POINTER	(1 << 2)
 
 // Task handle
 static TaskHandle_t sensor_task_handle = NULL;
 
+static TimerHandle_t adc_timer_handle = NULL;
+
 // Tidal volume estimator
 static TimerHandle_t volume_estimator_handle = NULL;
 static TimerHandle_t fs6122_read_handle = NULL;
 
+// Static storage for the kernel objects above
+static StaticTask_t sensor_task_buffer;
+static StackType_t sensor_task_stack[taskSENSOR_TASK_STACK_SIZE];
+static StaticTimer_t adc_timer_buffer;
+static StaticTimer_t volume_estimator_buffer;
+static StaticTimer_t fs6122_read_buffer;
+
 static volatile float recent_tidal_volume_liter = 0.0;
+static volatile float leak_slpm = 0.0;
+
+/*
+*	\brief Timer callback for requesting ADC read
+*
+*	\param xTimer The timer handle
+*/
+static void vADCRequestTriggerCallback( TimerHandle_t xTimer )
+{
+	UNUSED(xTimer);
+	xTaskNotify(sensor_task_handle, SENSOR_NOTIFY_ADC, eSetBits);
+}
 
 /*
 *	\brief Timer callback for sending I2C command to reset internal address pointer
@@ -52,7 +91,8 @@ static volatile float recent_tidal_volume_liter = 0.0;
 */
 static void vFS6122ReadTimerCallback( TimerHandle_t xTimer )
 {
-	reset_fs6122_read_pointer();
+	UNUSED(xTimer);
+	xTaskNotify(sensor_task_handle, SENSOR_NOTIFY_FLOW_POINTER, eSetBits);
 }
 
 /*
@@ -63,25 +103,51 @@ static void vFS6122ReadTimerCallback( TimerHandle_t xTimer )
 static void vTidalVolumeTimerCallback( TimerHandle_t xTimer )
 {
 	UNUSED(xTimer);
+	xTaskNotify(sensor_task_handle, SENSOR_NOTIFY_TIDAL_VOLUME, eSetBits);
+}
 
+/*
+*	\brief Integrates flow into tidal volume, then requests the next flow reading
+*
+*	A mask leak, or a sensor offset, shows up as more volume in than out over a breath.
+*	That imbalance over the breath time corrects the leak estimate once per breath, and the
+*	estimate comes off every flow sample, so volumes are what reached the patient. Only
+*	breaths close to the set period count, a noise crossing would leave a window holding
+*	most of a tidal volume.
+*/
+static void update_tidal_volume(void)
+{
 	static float flow_volume = 0.0;
 	static float tidal_volume = 0.0;
 	static float filtered_rate = 0.0;
 	static float last_filtered_rate = 0.0;
 	static bool rising = true;
 	static uint32_t last_time = 0;
+	static float breath_time = 0.0;
+	static bool full_breath = false;
 
 	uint32_t current_time = xTaskGetTickCount();
 
 	siargo_fs6122_data_t data;
 	read_fs6122_data(&data);
-	float flow_slm = data.flow_thousand_slpm * 0.001;
+	// Start over each time ventilation starts
+	if(!system_is_enabled())
+	{
+		leak_slpm = 0.0;
+		full_breath = false;
+	}
+
+	float flow_slm = data.flow_thousand_slpm * 0.001 - leak_slpm;
 
 	float alpha = 0.7;
 	filtered_rate = (alpha)*filtered_rate + (1.0-alpha)*flow_slm;
 	float dt = 0.001 * (current_time - last_time); // Time in seconds
 	flow_volume += flow_slm * (1.0/60.0) * dt;  // flow change in liters
-	tidal_volume += abs(flow_slm) * (1.0/60.0) *dt * 0.5;	// total tidal flow change
+	tidal_volume += fabsf(flow_slm) * (1.0/60.0) *dt * 0.5;	// total tidal flow change
+	breath_time += dt;
+
+	// Volume is relative to the end of inspiration, the fit's pressure offset takes that up
+	lung_mechanics_update(get_pressure_sensor_cmH2O_voted(), flow_slm * (1.0/60.0), flow_volume);
 
 	if(rising && filtered_rate > 0.0 && last_filtered_rate <= 0.0)
 	{
@@ -90,6 +156,24 @@ static void vTidalVolumeTimerCallback( TimerHandle_t xTimer )
 	else if(!rising && filtered_rate < 0.0 && last_filtered_rate >= 0.0)
 	{
 		recent_tidal_volume_liter = tidal_volume;
+		lung_mechanics_end_of_breath();
+
+		// The first reset ends a partial breath, and a noise crossing a short one
+		float breath_period_s = 60.0 / get_current_settings().breath_per_min;
+		if(full_breath && fabsf(breath_time - breath_period_s) < LEAK_BREATH_TOLERANCE * breath_period_s)
+		{
+			leak_slpm += LEAK_ESTIMATE_GAIN * (flow_volume * 60.0 / breath_time);
+			if(leak_slpm > LEAK_MAX_SLPM)
+			{
+				leak_slpm = LEAK_MAX_SLPM;
+			}
+			if(leak_slpm < LEAK_MIN_SLPM)
+			{
+				leak_slpm = LEAK_MIN_SLPM;
+			}
+		}
+		full_breath = true;
+		breath_time = 0.0;
 		// Reset
 		flow_volume = 0.0;
 		tidal_volume = 0.0;
@@ -112,37 +196,79 @@ static void sensor_hw_init(void)
 	fs6122_init();
 
 	adc_interface_init();
+
+	lung_mechanics_init();
+
+	telemetry_register(TELEMETRY_TIDAL_VOLUME, TELEMETRY_FLOAT, &recent_tidal_volume_liter);
+	telemetry_register(TELEMETRY_LEAK, TELEMETRY_FLOAT, &leak_slpm);
 }
 
 /*
 *	\brief The sensor task
+*
+*	Timers only notify this task, so sensor work runs at this task's priority instead of
+*	the timer task's.
 */
 static void sensor_task(void * pvParameters)
 {
 	UNUSED(pvParameters);
 
+	uint32_t notified;
+
 	sensor_hw_init();
 
-	volume_estimator_handle = xTimerCreate("TIDALV",
+	adc_timer_handle = xTimerCreateStatic("ADCTH",
+		pdMS_TO_TICKS(ADC_PERIOD_MS),
+		pdTRUE,
+		(void *) 0,
+		vADCRequestTriggerCallback,
+		&adc_timer_buffer);
+
+	if(adc_timer_handle)
+	{
+		xTimerStart(adc_timer_handle, 0);
+	}
+
+	volume_estimator_handle = xTimerCreateStatic("TIDALV",
 		pdMS_TO_TICKS(TIDAL_VOLUME_PERIOD_MS),
 		pdTRUE,
 		(void *) 0,
-		vTidalVolumeTimerCallback);
+		vTidalVolumeTimerCallback,
+		&volume_estimator_buffer);
 
 	if(volume_estimator_handle)
 	{
 		xTimerStart(volume_estimator_handle, 0);
 	}
 
-	fs6122_read_handle = xTimerCreate("FLOWS",
+	fs6122_read_handle = xTimerCreateStatic("FLOWS",
 		pdMS_TO_TICKS(TIDAL_VOLUME_PERIOD_MS/2), // half time
 		pdFALSE,
 		(void *) 0,
-		vFS6122ReadTimerCallback);
+		vFS6122ReadTimerCallback,
+		&fs6122_read_buffer);
 	
 	for (;;)
 	{
-		vTaskDelay(pdMS_TO_TICKS(1000)); // TODO do something here
+		xTaskNotifyWait(0, UINT32_MAX, &notified, portMAX_DELAY);
+
+		if(notified & SENSOR_NOTIFY_ADC)
+		{
+			adc_request_update();
+		}
+
+		if(notified & SENSOR_NOTIFY_FLOW_POINTER)
+		{
+			reset_fs6122_read_pointer();
+		}
+
+		if(notified & SENSOR_NOTIFY_TIDAL_VOLUME)
+		{
+			update_tidal_volume();
+			heartbeat_beat(HEARTBEAT_SENSOR);
+
+			adc_stream_process();
+		}
 	}
 }
 
@@ -154,8 +280,10 @@ static void sensor_task(void * pvParameters)
 */
 void create_sensor_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_priority)
 {
-	xTaskCreate(sensor_task, (const char * const) "SENSOR",
-		stack_depth_words, NULL, task_priority, &sensor_task_handle);
+	configASSERT(stack_depth_words <= taskSENSOR_TASK_STACK_SIZE);
+
+	sensor_task_handle = xTaskCreateStatic(sensor_task, (const char * const) "SENSOR",
+		stack_depth_words, NULL, task_priority, sensor_task_stack, &sensor_task_buffer);
 }
 
 /*
@@ -164,4 +292,14 @@ void create_sensor_task(uint16_t stack_depth_words, unsigned portBASE_TYPE task_
 float get_tidal_volume_liter(void)
 {
 	return recent_tidal_volume_liter;
+}
+
+/*
+*	\brief Gets the estimated leak, updated each breath
+*
+*	\return Leak flow in standard liters per minute
+*/
+float get_leak_rate_slpm(void)
+{
+	return leak_slpm;
 }
\ No newline at end of file
@@ -32,5 +32,6 @@ SOFTWARE.*/
 #define TASK_SENSOR_H_
 
 float get_tidal_volume_liter(void);
+float get_leak_rate_slpm(void);
 
 #endif /* TASK_SENSOR_H_ */
\ No newline at end of file